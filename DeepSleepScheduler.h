@@ -27,6 +27,48 @@
     from the watchdog interrupt. This means that e.g. delay() does not work.
   - #define SUPERVISION_CALLBACK_TIMEOUT: Specify the timeout of the callback on AVR until the watchdog resets the CPU. Defaults to WDTO_1S.
   - #define AWAKE_INDICATION_PIN: Show on a LED if the CPU is active or in sleep mode. HIGH = active, LOW = sleeping.
+  - #define TASK_POOL_SIZE: Allocate tasks from a static pool with the specified number of entries instead of the heap.
+    Scheduling then takes constant time and does not fragment the heap. When the pool is exhausted, the task is
+    not scheduled and the counter returned by getTaskPoolOverflowCount() is increased.
+  - #define TASK_HANDLES: Enables scheduleDelayed() and scheduleAt() with a TaskHandle to cancel() or
+    reschedule the task later. Requires TASK_POOL_SIZE.
+  - #define SCHEDULE_BATCH: Enables scheduleBatch() to schedule several callbacks with one lock of the run queue.
+  - #define ESP32_DUAL_CORE: Enables the schedule methods with a TaskCore to run tasks on the second core of ESP32.
+    Tasks without TaskCore still run on the core that calls execute().
+  - #define TASK_QUEUE_HEAP: Use a binary min-heap instead of a sorted linked list as run queue. Scheduling then
+    takes O(log n) instead of O(n), what keeps the time with interrupts disabled short for long queues.
+  - #define TASK_QUEUE_HEAP_SIZE: The maximal number of tasks in the heap. Defaults to TASK_POOL_SIZE if defined, 32 otherwise.
+    When the heap is full, the task is not scheduled and the counter returned by getTaskQueueOverflowCount() is increased.
+  - #define TASK_QUEUE_TIMING_WHEEL: Use a hierarchical timing wheel as run queue. Scheduling and removing a task then
+    take constant time independent of the number of tasks. Useful with a large number of delayed tasks.
+  - #define TASK_CALLBACK_INDEX_SIZE: Keep an index of the scheduled tasks per callback and Runnable with the specified
+    number of entries. isScheduled() then takes constant time and removeCallbacks() and scheduleOnce() only visit the
+    tasks of the given callback. When more different callbacks are scheduled than the index can hold, the task is
+    not scheduled and the counter returned by getTaskCallbackIndexOverflowCount() is increased.
+  - #define SUBMISSION_RING_SIZE: Enables scheduleFromInterrupt() with a ring buffer of the specified size (max 255).
+    Interrupts add callbacks to it without disabling interrupts and execute() moves them to the run queue.
+  - #define TASK_PRIORITIES: Enables the schedule methods with a TaskPriority. When several tasks are due, the ones
+    with the highest priority run first and tasks with the same priority run in the order of their schedule time.
+  - #define TASK_DEADLINES: Enables scheduleWithDeadline(). When several tasks are due, the one with the earliest
+    deadline runs first. Tasks that finish after their deadline are counted and reported to setDeadlineMissCallback().
+  - #define RESUMABLE_TASKS: Enables ResumableRunnable, a Runnable that can sleep in the middle of run() by using
+    the macros RESUMABLE_BEGIN(), RESUMABLE_SLEEP_FOR(), RESUMABLE_YIELD() and RESUMABLE_END().
+  - #define CONTEXT_CALLBACKS: Enables the schedule methods for callbacks of type void (*)(void*) with a context
+    that is stored in the task and passed to the callback and for methods of classes that do not extend Runnable.
+  - #define PERIODIC_TASKS: Enables scheduleFixedRate() and scheduleFixedDelay() to run a task repeatedly.
+  - #define TIMER_SLACK: Enables scheduleDelayed() and scheduleAt() with a tolerance. The CPU then wakes up from sleep
+    at a time where as many tasks as possible can run within their tolerance to save wakeups.
+  - #define TASK_STATS_SIZE: Record the number of runs, the run time and the lateness per callback and Runnable
+    in a table with the specified number of entries. Read it with getTaskStats().
+  - #define SLEEP_STATS: Record the time spent awake, in idle and in sleep mode and count the wakeups from sleep.
+    Read it with getSleepStats().
+  - #define NO_SLEEP_CURRENT_MICROAMPS, IDLE_CURRENT_MICROAMPS and SLEEP_CURRENT_MICROAMPS: The current consumption
+    of the board in each mode. Together with SLEEP_STATS, they enable getAverageCurrentMicroAmps().
+  - #define TRACE_BUFFER_SIZE: Record scheduler events in a ring buffer with the specified number of 8 byte records.
+    Print them with dumpTrace() and decode the output with extras/trace_decoder.py.
+
+  When compiled without Arduino, e.g. on Linux, the host simulation is used. It simulates the Arduino API with a
+  virtual clock, see DeepSleepScheduler_host_includes.h. Use executeUntil() to run the scheduler for a given time.
 */
 
 #ifndef DEEP_SLEEP_SCHEDULER_H
@@ -35,11 +77,52 @@
 // -------------------------------------------------------------------------------------------------
 // Definition (usually in H file)
 // -------------------------------------------------------------------------------------------------
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include "DeepSleepScheduler_host_includes.h"
+#endif
 #if defined(ESP32) || defined(ESP8266)
 #include "DeepSleepScheduler_esp_includes.h"
 #endif
 
+#if defined(TASK_QUEUE_HEAP) && defined(TASK_QUEUE_TIMING_WHEEL)
+#error "Only one of TASK_QUEUE_HEAP and TASK_QUEUE_TIMING_WHEEL can be defined"
+#endif
+
+#if defined(TASK_HANDLES) && !defined(TASK_POOL_SIZE)
+#error "TASK_HANDLES requires TASK_POOL_SIZE"
+#endif
+
+#if defined(ESP32_DUAL_CORE) && !defined(ESP32)
+#error "ESP32_DUAL_CORE is only supported on ESP32"
+#endif
+
+#if defined(SUBMISSION_RING_SIZE) && SUBMISSION_RING_SIZE > 255
+#error "SUBMISSION_RING_SIZE must not be greater than 255"
+#endif
+
+#ifdef ESP32_DUAL_CORE
+// noInterrupts() only disables the interrupts of the calling core but the run queue is
+// shared with the second core, so a spinlock is used. The macros are restored at the end.
+#pragma push_macro("noInterrupts")
+#pragma push_macro("interrupts")
+#undef noInterrupts
+#undef interrupts
+#define noInterrupts() portENTER_CRITICAL_SAFE(&Scheduler::taskMux)
+#define interrupts() portEXIT_CRITICAL_SAFE(&Scheduler::taskMux)
+#endif
+
+#if defined(TASK_PRIORITIES) || defined(TASK_DEADLINES)
+// due tasks are moved to ready lists before they run
+#define TASK_READY_LISTS
+#endif
+
+#if (defined(TASK_CALLBACK_INDEX_SIZE) || defined(TASK_HANDLES)) && !defined(TASK_QUEUE_HEAP) && !defined(TASK_QUEUE_TIMING_WHEEL)
+// the tasks of the list run queue also link to the previous one to be removed in constant time
+#define TASK_QUEUE_LIST_PREVIOUS
+#endif
+
 #define BUFFER_TIME 2
 #define NOT_USED 255
 
@@ -57,6 +140,58 @@ enum TaskTimeout {
   NO_SUPERVISION
 };
 
+#ifdef TASK_PRIORITIES
+/**
+  Priority of a task, see TASK_PRIORITIES. Tasks scheduled without priority have PRIORITY_NORMAL.
+*/
+enum TaskPriority {
+  PRIORITY_LOW,
+  PRIORITY_NORMAL,
+  PRIORITY_HIGH,
+  PRIORITY_HIGHEST
+};
+#define TASK_PRIORITY_COUNT 4
+#endif
+
+#ifdef TASK_HANDLES
+/**
+  Identifies one scheduled task to cancel or reschedule it, see TASK_HANDLES.
+*/
+struct TaskHandle {
+  TaskHandle() : id(0) {
+  }
+  /**
+    index + 1 of the task in the task pool in the lower and its generation in the upper 16 bits,
+    0 if no task was scheduled
+  */
+  unsigned long id;
+};
+#endif
+
+#ifdef SCHEDULE_BATCH
+/**
+  One callback of scheduleBatch(), see SCHEDULE_BATCH.
+*/
+struct ScheduleBatchEntry {
+  void (*callback)();
+  unsigned long delayMillis;
+};
+#endif
+
+#ifdef ESP32_DUAL_CORE
+/**
+  The core a task runs on, see ESP32_DUAL_CORE.
+*/
+enum TaskCore {
+  TASK_CORE_0,
+  TASK_CORE_1,
+  // the core that is free first
+  TASK_CORE_ANY,
+  // the core that calls execute(), used by the schedule methods without TaskCore
+  TASK_CORE_MAIN
+};
+#endif
+
 /**
   Extend from Runnable in order to have the run() method run by the scheduler.
 */
@@ -129,21 +264,391 @@ class Scheduler {
     */
     void scheduleAt(Runnable *runnable, unsigned long uptimeMillis);
 
+#ifdef CONTEXT_CALLBACKS
+    /**
+      Schedule the callback as soon as possible but after other tasks
+      that are to be scheduled immediately and are in the queue already.
+      The same callback can be scheduled with different contexts, e.g. one per sensor.
+      @param callback: the method to be called on the main thread
+      @param context: passed to the callback, e.g. a pointer to the data it works on
+    */
+    void schedule(void (*callback)(void*), void *context);
+
+    /**
+      Schedule the callback as soon as possible and remove all other
+      tasks with the same callback and context.
+      @param callback: the method to be called on the main thread
+      @param context: passed to the callback
+    */
+    void scheduleOnce(void (*callback)(void*), void *context);
+
+    /**
+      Schedule the callback after delayMillis milliseconds.
+      @param callback: the method to be called on the main thread
+      @param context: passed to the callback
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+    */
+    void scheduleDelayed(void (*callback)(void*), void *context, unsigned long delayMillis);
+
+    /**
+      Schedule the callback uptimeMillis milliseconds after the device was started.
+      @param callback: the method to be called on the main thread
+      @param context: passed to the callback
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+    */
+    void scheduleAt(void (*callback)(void*), void *context, unsigned long uptimeMillis);
+
+    /**
+      Schedule the method of the object as soon as possible, e.g.
+      scheduler.schedule<Led, &Led::toggle>(&led);
+      The class does not need to extend Runnable. The method is called through a function
+      generated for it with the object as context, so it is dispatched like a callback
+      with context and without virtual method. Tasks of a Runnable still call the virtual run().
+      @param object: the object on which the method will be called on the main thread
+    */
+    template <class T, void (T::*method)()> void schedule(T *object) {
+      schedule(methodCallback<T, method>, object);
+    }
+    /**
+      Schedule the method of the object as soon as possible and remove all other
+      tasks with the same method and object.
+      @param object: the object on which the method will be called on the main thread
+    */
+    template <class T, void (T::*method)()> void scheduleOnce(T *object) {
+      scheduleOnce(methodCallback<T, method>, object);
+    }
+    /**
+      Schedule the method of the object after delayMillis milliseconds.
+      @param object: the object on which the method will be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the method shall be called
+    */
+    template <class T, void (T::*method)()> void scheduleDelayed(T *object, unsigned long delayMillis) {
+      scheduleDelayed(methodCallback<T, method>, object, delayMillis);
+    }
+    /**
+      Schedule the method of the object uptimeMillis milliseconds after the device was started.
+      @param object: the object on which the method will be called on the main thread
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to call the method.
+    */
+    template <class T, void (T::*method)()> void scheduleAt(T *object, unsigned long uptimeMillis) {
+      scheduleAt(methodCallback<T, method>, object, uptimeMillis);
+    }
+#endif
+
+#ifdef TIMER_SLACK
+    /**
+      Schedule the callback after delayMillis milliseconds but allow it to run up to
+      toleranceMillis later. When the CPU sleeps, it wakes up at a time where as many tasks
+      as possible can run within their tolerance. This saves wakeups and therefore power.
+      @param callback: the method to be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param toleranceMillis: the time in milliseconds the callback may be delayed further
+    */
+    void scheduleDelayed(void (*callback)(), unsigned long delayMillis, unsigned long toleranceMillis);
+    /**
+      Schedule the Runnable after delayMillis milliseconds but allow it to run up to
+      toleranceMillis later. When the CPU sleeps, it wakes up at a time where as many tasks
+      as possible can run within their tolerance. This saves wakeups and therefore power.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param toleranceMillis: the time in milliseconds the callback may be delayed further
+    */
+    void scheduleDelayed(Runnable *runnable, unsigned long delayMillis, unsigned long toleranceMillis);
+
+    /**
+      Schedule the callback uptimeMillis milliseconds after the device was started but allow
+      it to run up to toleranceMillis later. See scheduleDelayed() with tolerance.
+      @param callback: the method to be called on the main thread
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+      @param toleranceMillis: the time in milliseconds the callback may be delayed further
+    */
+    void scheduleAt(void (*callback)(), unsigned long uptimeMillis, unsigned long toleranceMillis);
+    /**
+      Schedule the Runnable uptimeMillis milliseconds after the device was started but allow
+      it to run up to toleranceMillis later. See scheduleDelayed() with tolerance.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+      @param toleranceMillis: the time in milliseconds the callback may be delayed further
+    */
+    void scheduleAt(Runnable *runnable, unsigned long uptimeMillis, unsigned long toleranceMillis);
+
+    /**
+      return: The number of tasks that were run in the wakeup of an earlier task
+              instead of waking up the CPU for them separately.
+    */
+    unsigned long getSavedWakeupCount() const;
+#endif
+
+#ifdef TASK_PRIORITIES
+    /**
+      Schedule the callback as soon as possible but after tasks with a higher priority
+      and other tasks with the same priority that are due already.
+      @param callback: the method to be called on the main thread
+      @param priority: the priority of the task
+    */
+    void schedule(void (*callback)(), const TaskPriority priority);
+    /**
+      Schedule the Runnable as soon as possible but after tasks with a higher priority
+      and other tasks with the same priority that are due already.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param priority: the priority of the task
+    */
+    void schedule(Runnable *runnable, const TaskPriority priority);
+
+    /**
+      Like scheduleOnce() but with the given priority.
+      @param callback: the method to be called on the main thread
+      @param priority: the priority of the task
+    */
+    void scheduleOnce(void (*callback)(), const TaskPriority priority);
+    /**
+      Like scheduleOnce() but with the given priority.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param priority: the priority of the task
+    */
+    void scheduleOnce(Runnable *runnable, const TaskPriority priority);
+
+    /**
+      Schedule the callback after delayMillis milliseconds with the given priority.
+      @param callback: the method to be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param priority: the priority of the task
+    */
+    void scheduleDelayed(void (*callback)(), unsigned long delayMillis, const TaskPriority priority);
+    /**
+      Schedule the Runnable after delayMillis milliseconds with the given priority.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param priority: the priority of the task
+    */
+    void scheduleDelayed(Runnable *runnable, unsigned long delayMillis, const TaskPriority priority);
+
+    /**
+      Schedule the callback uptimeMillis milliseconds after the device was started with the given priority.
+      @param callback: the method to be called on the main thread
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+      @param priority: the priority of the task
+    */
+    void scheduleAt(void (*callback)(), unsigned long uptimeMillis, const TaskPriority priority);
+    /**
+      Schedule the Runnable uptimeMillis milliseconds after the device was started with the given priority.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+      @param priority: the priority of the task
+    */
+    void scheduleAt(Runnable *runnable, unsigned long uptimeMillis, const TaskPriority priority);
+#endif
+
+#ifdef TASK_DEADLINES
+    /**
+      Schedule the callback after delayMillis milliseconds with a deadline. When several tasks are due,
+      the one with the earliest deadline runs first, before tasks without deadline.
+      If the callback finishes later than deadlineMillis after its schedule time, it is counted
+      in getDeadlineMissCount() and reported to the callback set by setDeadlineMissCallback().
+      @param callback: the method to be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param deadlineMillis: the time in milliseconds after the schedule time until the callback
+                             must have finished, must not be 0
+    */
+    void scheduleWithDeadline(void (*callback)(), unsigned long delayMillis, unsigned long deadlineMillis);
+    /**
+      Schedule the Runnable after delayMillis milliseconds with a deadline. When several tasks are due,
+      the one with the earliest deadline runs first, before tasks without deadline.
+      If run() finishes later than deadlineMillis after its schedule time, it is counted
+      in getDeadlineMissCount() and reported to the callback set by setDeadlineMissCallback().
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param deadlineMillis: the time in milliseconds after the schedule time until run()
+                             must have finished, must not be 0
+    */
+    void scheduleWithDeadline(Runnable *runnable, unsigned long delayMillis, unsigned long deadlineMillis);
+
+    /**
+      Sets the method to be called on the main thread after a task finished later than its deadline.
+      It receives the callback or the Runnable of the task (the other one is NULL) and
+      how many milliseconds the task finished too late.
+      With ESP32_DUAL_CORE, tasks with a deadline always run on the core that calls execute(),
+      so the method is also called there.
+      @param deadlineMissCallback: the method to be called or NULL to not be informed
+    */
+    void setDeadlineMissCallback(void (*deadlineMissCallback)(void (*callback)(), Runnable *runnable, unsigned long lateMillis)) {
+      this->deadlineMissCallback = deadlineMissCallback;
+    }
+
+    /**
+      return: The number of tasks that finished later than their deadline.
+    */
+    unsigned long getDeadlineMissCount() const;
+
+    /**
+      return: The maximal time in milliseconds a task finished later than its deadline.
+    */
+    unsigned long getMaxDeadlineMissMillis() const;
+#endif
+
+#ifdef PERIODIC_TASKS
+    /**
+      Schedule the callback repeatedly every periodMillis milliseconds. The time of the next run
+      is calculated from the schedule time of the previous run, so the runs do not drift.
+      If a run finishes after one or more whole further periods passed, these periods are skipped
+      and counted in getSkippedPeriodCount(). A run that is due when the previous one finishes runs late.
+      Use removeCallbacks() to stop it, also from within the callback.
+      @param callback: the method to be called on the main thread
+      @param initialDelayMillis: the time to wait in milliseconds until the first run
+      @param periodMillis: the time in milliseconds between the start of two runs, must not be 0
+    */
+    void scheduleFixedRate(void (*callback)(), unsigned long initialDelayMillis, unsigned long periodMillis);
+    /**
+      Schedule the Runnable repeatedly every periodMillis milliseconds. The time of the next run
+      is calculated from the schedule time of the previous run, so the runs do not drift.
+      If a run finishes after one or more whole further periods passed, these periods are skipped
+      and counted in getSkippedPeriodCount(). A run that is due when the previous one finishes runs late.
+      Use removeCallbacks() to stop it, also from within run().
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param initialDelayMillis: the time to wait in milliseconds until the first run
+      @param periodMillis: the time in milliseconds between the start of two runs, must not be 0
+    */
+    void scheduleFixedRate(Runnable *runnable, unsigned long initialDelayMillis, unsigned long periodMillis);
+
+    /**
+      Schedule the callback repeatedly with delayMillis milliseconds between the end of
+      a run and the start of the next one.
+      Use removeCallbacks() to stop it, also from within the callback.
+      @param callback: the method to be called on the main thread
+      @param initialDelayMillis: the time to wait in milliseconds until the first run
+      @param delayMillis: the time in milliseconds from the end of a run to the start of the next one, must not be 0
+    */
+    void scheduleFixedDelay(void (*callback)(), unsigned long initialDelayMillis, unsigned long delayMillis);
+    /**
+      Schedule the Runnable repeatedly with delayMillis milliseconds between the end of
+      a run and the start of the next one.
+      Use removeCallbacks() to stop it, also from within run().
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param initialDelayMillis: the time to wait in milliseconds until the first run
+      @param delayMillis: the time in milliseconds from the end of a run to the start of the next one, must not be 0
+    */
+    void scheduleFixedDelay(Runnable *runnable, unsigned long initialDelayMillis, unsigned long delayMillis);
+
+    /**
+      return: The number of periods of tasks scheduled with scheduleFixedRate() that were skipped
+              because a run was too late.
+    */
+    unsigned long getSkippedPeriodCount() const;
+#endif
+
     /**
       Schedule the callback method as next task even if other tasks are in the queue already.
+      With TASK_PRIORITIES, tasks with a higher priority still run before it.
       @param callback: the method to be called on the main thread
     */
     void scheduleAtFrontOfQueue(void (*callback)());
     /**
       Schedule the callback method as next task even if other tasks are in the queue already.
+      With TASK_PRIORITIES, tasks with a higher priority still run before it.
       @param runnable: the Runnable on which the run() method will be called on the main thread
     */
     void scheduleAtFrontOfQueue(Runnable *runnable);
 
+#ifdef SCHEDULE_BATCH
+    /**
+      Schedule all callbacks of the entries, each after its delayMillis milliseconds, e.g. when
+      an event starts several tasks. The tasks are sorted by time before interrupts are disabled
+      and are then added to the run queue at once. With the default run queue, they are merged in
+      one pass through it. Callbacks with the same time run in the order of the entries.
+      @param entries: the callbacks and their delays
+      @param count: the number of entries
+    */
+    void scheduleBatch(const ScheduleBatchEntry *entries, byte count);
+#endif
+
+#ifdef ESP32_DUAL_CORE
+    /**
+      Schedule the callback as soon as possible on the given core. Tasks for the other core
+      run in parallel to the tasks of the core that calls execute(), so data they share must
+      be protected, e.g. with a portMUX_TYPE.
+      @param callback: the method to be called
+      @param core: the core to run the task on or TASK_CORE_ANY for the one that is free first
+    */
+    void schedule(void (*callback)(), const TaskCore core);
+    /**
+      Schedule the Runnable as soon as possible on the given core.
+      @param runnable: the Runnable on which the run() method will be called
+      @param core: the core to run the task on or TASK_CORE_ANY for the one that is free first
+    */
+    void schedule(Runnable *runnable, const TaskCore core);
+
+    /**
+      Schedule the callback after delayMillis milliseconds on the given core.
+      @param callback: the method to be called
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param core: the core to run the task on or TASK_CORE_ANY for the one that is free first
+    */
+    void scheduleDelayed(void (*callback)(), unsigned long delayMillis, const TaskCore core);
+    /**
+      Schedule the Runnable after delayMillis milliseconds on the given core.
+      @param runnable: the Runnable on which the run() method will be called
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param core: the core to run the task on or TASK_CORE_ANY for the one that is free first
+    */
+    void scheduleDelayed(Runnable *runnable, unsigned long delayMillis, const TaskCore core);
+
+    /**
+      Schedule the callback uptimeMillis milliseconds after the device was started on the given core.
+      @param callback: the method to be called
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+      @param core: the core to run the task on or TASK_CORE_ANY for the one that is free first
+    */
+    void scheduleAt(void (*callback)(), unsigned long uptimeMillis, const TaskCore core);
+    /**
+      Schedule the Runnable uptimeMillis milliseconds after the device was started on the given core.
+      @param runnable: the Runnable on which the run() method will be called
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+      @param core: the core to run the task on or TASK_CORE_ANY for the one that is free first
+    */
+    void scheduleAt(Runnable *runnable, unsigned long uptimeMillis, const TaskCore core);
+#endif
+
+#ifdef SUBMISSION_RING_SIZE
+    /**
+      Schedule the callback method as soon as possible from an interrupt without
+      disabling interrupts. The callback is added to a ring buffer and moved
+      to the run queue by execute() before the next task is run.
+      @param callback: the method to be called on the main thread
+      return: false if the ring buffer is full and the callback was dropped
+    */
+    bool scheduleFromInterrupt(void (*callback)());
+    /**
+      Schedule the Runnable as soon as possible from an interrupt without
+      disabling interrupts. The Runnable is added to a ring buffer and moved
+      to the run queue by execute() before the next task is run.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      return: false if the ring buffer is full and the Runnable was dropped
+    */
+    bool scheduleFromInterrupt(Runnable *runnable);
+
+    /**
+      return: The maximal number of entries that were in the ring buffer of scheduleFromInterrupt() at the same time.
+    */
+    byte getSubmissionRingHighWaterMark() const;
+
+    /**
+      return: The number of callbacks dropped by scheduleFromInterrupt() because the ring buffer was full.
+    */
+    unsigned int getSubmissionRingDropCount() const;
+#endif
+
     /**
       Check if this callback is scheduled at least once already.
       This method can be called in an interrupt but bear in mind, that it loops through
-      the run queue until it finds it or reaches the end.
+      the run queue until it finds it or reaches the end unless TASK_CALLBACK_INDEX_SIZE is defined.
       @param callback: callback to check
     */
     bool isScheduled(void (*callback)()) const;
@@ -151,11 +656,27 @@ class Scheduler {
     /**
       Check if this runnable is scheduled at least once already.
       This method can be called in an interrupt but bear in mind, that it loops through
-      the run queue until it finds it or reaches the end.
+      the run queue until it finds it or reaches the end unless TASK_CALLBACK_INDEX_SIZE is defined.
       @param runnable: Runnable to check
     */
     bool isScheduled(Runnable *runnable) const;
 
+#ifdef CONTEXT_CALLBACKS
+    /**
+      Check if this callback is scheduled with this context at least once already.
+      @param callback: callback to check
+      @param context: context to check
+    */
+    bool isScheduled(void (*callback)(void*), void *context) const;
+    /**
+      Check if this method is scheduled for this object at least once already.
+      @param object: object to check
+    */
+    template <class T, void (T::*method)()> bool isScheduled(T *object) const {
+      return isScheduled(methodCallback<T, method>, object);
+    }
+#endif
+
     /**
       Returns the scheduled time of the task that is currently running.
       If no task is currently running, 0 is returned.
@@ -172,6 +693,21 @@ class Scheduler {
       @param runnable: instance of Runnable of which all schedules shall be removed
     */
     void removeCallbacks(Runnable *runnable);
+#ifdef CONTEXT_CALLBACKS
+    /**
+      Cancel all schedules that were scheduled for this callback with this context.
+      @param callback: method of which the schedules shall be removed
+      @param context: context of the schedules to be removed
+    */
+    void removeCallbacks(void (*callback)(void*), void *context);
+    /**
+      Cancel all schedules of this method for this object.
+      @param object: object of which the schedules of the method shall be removed
+    */
+    template <class T, void (T::*method)()> void removeCallbacks(T *object) {
+      removeCallbacks(methodCallback<T, method>, object);
+    }
+#endif
 
     /**
       Acquire a lock to prevent the CPU from entering sleep.
@@ -213,44 +749,280 @@ class Scheduler {
     */
     unsigned long getMillis() const;
 
-#ifdef SUPERVISION_CALLBACK
-#ifdef ESP8266
-#error "SUPERVISION_CALLBACK not supported for ESP8266"
-#endif
     /**
-      Sets the runnable to be called when the task supervision detects a task that runs too long.
-      The run() method will be called from the watchdog interrupt what means, that
-      e.g. the method delay() does not work.
-      On AVR, when run() returns, the CPU will be restarted after 15ms.
-      On ESP32, the interrupt service routine as a whole has a time limit and calls
-      abort() when returning from this method.
-      See description of SUPERVISION_CALLBACK and SUPERVISION_CALLBACK_TIMEOUT.
-      @param runnable: instance of Runnable where the run() method is called
+      return: The same as getMillis() but extended to 64 bit so that it does not wrap
+              after 49.7 days. It requires that getMillis64() or execute() runs at least
+              once every 24.8 days (2^31 ms) as the wrap is detected by comparing with the
+              previous call. execute() does so after every wakeup, so a single sleep must not
+              be longer, i.e. no task may be scheduled more than 24.8 days ahead.
     */
-    void setSupervisionCallback(Runnable *runnable) {
-      supervisionCallbackRunnable = runnable;
-    }
-#endif
+    uint64_t getMillis64();
 
+#ifdef TASK_POOL_SIZE
     /**
-      This method needs to be called from your loop() method and does not return.
+      return: The number of tasks that were not scheduled because the task pool was exhausted.
+              Increase TASK_POOL_SIZE if this value is not 0.
     */
-    void execute();
+    unsigned int getTaskPoolOverflowCount() const;
+#endif
 
+#ifdef TASK_HANDLES
     /**
-      Constructor of the scheduler. Do not all this method as there is only one instance of Scheduler supported.
+      Schedule the callback after delayMillis milliseconds and set the handle to cancel or reschedule it.
+      @param callback: the method to be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param handle: receives the handle of the task, its id is 0 if the task could not be scheduled
     */
-    Scheduler();
+    void scheduleDelayed(void (*callback)(), unsigned long delayMillis, TaskHandle &handle);
+    /**
+      Schedule the Runnable after delayMillis milliseconds and set the handle to cancel or reschedule it.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param delayMillis: the time to wait in milliseconds until the callback shall be made
+      @param handle: receives the handle of the task, its id is 0 if the task could not be scheduled
+    */
+    void scheduleDelayed(Runnable *runnable, unsigned long delayMillis, TaskHandle &handle);
 
-  private:
-    class Task {
-      public:
-        Task(const unsigned long scheduledUptimeMillis, const bool isCallbackTask)
-          : scheduledUptimeMillis(scheduledUptimeMillis), isCallbackTask(isCallbackTask), next(NULL) {
+    /**
+      Schedule the callback uptimeMillis milliseconds after the device was started
+      and set the handle to cancel or reschedule it.
+      @param callback: the method to be called on the main thread
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+      @param handle: receives the handle of the task, its id is 0 if the task could not be scheduled
+    */
+    void scheduleAt(void (*callback)(), unsigned long uptimeMillis, TaskHandle &handle);
+    /**
+      Schedule the Runnable uptimeMillis milliseconds after the device was started
+      and set the handle to cancel or reschedule it.
+      @param runnable: the Runnable on which the run() method will be called on the main thread
+      @param uptimeMillis: the time in milliseconds since the device was started
+                           to schedule the callback.
+      @param handle: receives the handle of the task, its id is 0 if the task could not be scheduled
+    */
+    void scheduleAt(Runnable *runnable, unsigned long uptimeMillis, TaskHandle &handle);
+
+    /**
+      Removes the task of the handle. Other tasks with the same callback stay scheduled.
+      @param handle: the handle set when the task was scheduled
+      return: false if the task already ran, was removed or is currently running
+    */
+    bool cancel(const TaskHandle &handle);
+
+    /**
+      Moves the task of the handle to run delayMillis milliseconds from now. The task is reused,
+      what is faster than removing it and scheduling a new one.
+      @param handle: the handle set when the task was scheduled
+      @param delayMillis: the time to wait in milliseconds until the task shall run
+      return: false if the task already ran, was removed or is currently running
+    */
+    bool rescheduleDelayed(const TaskHandle &handle, unsigned long delayMillis);
+
+    /**
+      Moves the task of the handle to run uptimeMillis milliseconds after the device was started.
+      @param handle: the handle set when the task was scheduled
+      @param uptimeMillis: the time in milliseconds since the device was started to run the task
+      return: false if the task already ran, was removed or is currently running
+    */
+    bool rescheduleAt(const TaskHandle &handle, unsigned long uptimeMillis);
+
+    /**
+      return: true if the task of the handle is scheduled and did not run yet.
+    */
+    bool isScheduled(const TaskHandle &handle) const;
+#endif
+
+#ifdef TASK_QUEUE_HEAP
+    /**
+      return: The number of tasks that were not scheduled because the heap was full.
+              Increase TASK_QUEUE_HEAP_SIZE if this value is not 0.
+    */
+    unsigned int getTaskQueueOverflowCount() const;
+#endif
+
+#ifdef TASK_CALLBACK_INDEX_SIZE
+    /**
+      return: The number of tasks that were not scheduled because the callback index was full.
+              Increase TASK_CALLBACK_INDEX_SIZE if this value is not 0.
+    */
+    unsigned int getTaskCallbackIndexOverflowCount() const;
+#endif
+
+#ifdef TASK_STATS_SIZE
+    /**
+      Statistics of all runs of a callback or Runnable.
+    */
+    struct TaskStats {
+      /**
+        the callback or NULL if the entry is for a Runnable
+      */
+      void (*callback)();
+      /**
+        the Runnable or NULL if the entry is for a callback
+      */
+      Runnable *runnable;
+      unsigned long runCount;
+      /**
+        run time measured with micros()
+      */
+      unsigned long totalRunMicros;
+      unsigned long maxRunMicros;
+      /**
+        time between the scheduled time and the start of the run
+      */
+      unsigned long totalLatenessMillis;
+      unsigned long maxLatenessMillis;
+    };
+
+    /**
+      With ESP32_DUAL_CORE, the tasks of the second core are recorded on that core while the lock is held.
+      return: The number of callbacks and Runnables with statistics. Use it with getTaskStats().
+    */
+    byte getTaskStatsCount() const;
+
+    /**
+      Copies the statistics of one callback or Runnable.
+      @param index: index of the entry from 0 to getTaskStatsCount() - 1
+      @param stats: receives the statistics
+      return: false if index is out of range
+    */
+    bool getTaskStats(const byte index, TaskStats &stats) const;
+
+    /**
+      Removes all entries of the statistics.
+    */
+    void resetTaskStats();
+
+    /**
+      return: The number of runs that were not recorded because the statistics table was full.
+              Increase TASK_STATS_SIZE if this value is not 0.
+    */
+    unsigned int getTaskStatsOverflowCount() const;
+#endif
+
+#ifdef SLEEP_STATS
+    /**
+      Time spent in each sleep mode and number of wakeups from sleep.
+    */
+    struct SleepStats {
+      /**
+        time the CPU was running, e.g. executing tasks
+      */
+      unsigned long noSleepMillis;
+      /**
+        time the CPU was waiting in idle mode, e.g. until a task is due but the time is too short for sleep
+      */
+      unsigned long idleMillis;
+      /**
+        time the CPU was in sleep mode
+      */
+      unsigned long sleepMillis;
+      /**
+        wakeups from sleep by the timer of the scheduler, the watchdog on AVR
+      */
+      unsigned long timerWakeupCount;
+      /**
+        wakeups from sleep by other interrupts, e.g. an external pin
+      */
+      unsigned long interruptWakeupCount;
+    };
+
+    /**
+      Copies the statistics since the start or since the last call of resetSleepStats().
+      @param stats: receives the statistics
+    */
+    void getSleepStats(SleepStats &stats) const;
+
+    /**
+      Sets all values of the statistics back to 0.
+    */
+    void resetSleepStats();
+
+#if defined(NO_SLEEP_CURRENT_MICROAMPS) || defined(IDLE_CURRENT_MICROAMPS) || defined(SLEEP_CURRENT_MICROAMPS)
+#if !defined(NO_SLEEP_CURRENT_MICROAMPS) || !defined(IDLE_CURRENT_MICROAMPS) || !defined(SLEEP_CURRENT_MICROAMPS)
+#error "NO_SLEEP_CURRENT_MICROAMPS, IDLE_CURRENT_MICROAMPS and SLEEP_CURRENT_MICROAMPS must be defined together"
+#endif
+    /**
+      Estimates the average current consumption from the time spent in each sleep mode
+      and the currents given by NO_SLEEP_CURRENT_MICROAMPS, IDLE_CURRENT_MICROAMPS and SLEEP_CURRENT_MICROAMPS.
+      return: the average current in micro ampere since the start or the last call of resetSleepStats()
+    */
+    unsigned long getAverageCurrentMicroAmps() const;
+#endif
+#endif
+
+#ifdef TRACE_BUFFER_SIZE
+    /**
+      Prints the recorded events as one line of hexadecimal digits per event and removes them
+      from the buffer. Decode the output with extras/trace_decoder.py.
+      @param output: where the events are printed to, e.g. Serial
+    */
+    void dumpTrace(Print &output);
+#endif
+
+#ifdef SUPERVISION_CALLBACK
+#ifdef ESP8266
+#error "SUPERVISION_CALLBACK not supported for ESP8266"
+#endif
+    /**
+      Sets the runnable to be called when the task supervision detects a task that runs too long.
+      The run() method will be called from the watchdog interrupt what means, that
+      e.g. the method delay() does not work.
+      On AVR, when run() returns, the CPU will be restarted after 15ms.
+      On ESP32, the interrupt service routine as a whole has a time limit and calls
+      abort() when returning from this method.
+      See description of SUPERVISION_CALLBACK and SUPERVISION_CALLBACK_TIMEOUT.
+      @param runnable: instance of Runnable where the run() method is called
+    */
+    void setSupervisionCallback(Runnable *runnable) {
+      supervisionCallbackRunnable = runnable;
+    }
+#endif
+
+    /**
+      This method needs to be called from your loop() method and does not return.
+    */
+    void execute();
+
+    /**
+      Constructor of the scheduler. Do not all this method as there is only one instance of Scheduler supported.
+    */
+    Scheduler();
+
+  private:
+    class Task {
+      public:
+        Task(const unsigned long scheduledUptimeMillis, const bool isCallbackTask)
+          : scheduledUptimeMillis(scheduledUptimeMillis), isCallbackTask(isCallbackTask) {
+#ifdef PERIODIC_TASKS
+          periodMillis = 0;
+#endif
+#ifdef TIMER_SLACK
+          toleranceMillis = 0;
+#endif
+#ifdef TASK_PRIORITIES
+          priority = PRIORITY_NORMAL;
+#endif
+#ifdef TASK_DEADLINES
+          deadlineMillis = 0;
+#endif
+#ifdef TASK_READY_LISTS
+          ready = false;
+#endif
+#ifdef ESP32_DUAL_CORE
+          core = TASK_CORE_MAIN;
+          handedOver = false;
+#endif
         }
         void execute() {
           // do in base class to prevent virtual method
           if (isCallbackTask) {
+#ifdef CONTEXT_CALLBACKS
+            CallbackTask *task = (CallbackTask*)this;
+            if (task->hasContext) {
+              ((void (*)(void*)) task->callback)(task->context);
+              return;
+            }
+#endif
             ((CallbackTask*)this)->callback();
           } else {
             ((RunnableTask*)this)->runnable->run();
@@ -259,23 +1031,131 @@ class Scheduler {
         bool equalCallback(Task *task) {
           // do in base class to prevent virtual method
           if (isCallbackTask) {
-            return task->isCallbackTask && ((CallbackTask*)task)->callback == ((CallbackTask*)this)->callback;
+            return task->isCallbackTask && ((CallbackTask*)task)->callback == ((CallbackTask*)this)->callback
+#ifdef CONTEXT_CALLBACKS
+                   && ((CallbackTask*)task)->hasContext == ((CallbackTask*)this)->hasContext
+                   && ((CallbackTask*)task)->context == ((CallbackTask*)this)->context
+#endif
+                   ;
           } else {
             return !task->isCallbackTask && ((RunnableTask*)task)->runnable == ((RunnableTask*)this)->runnable;
           }
         }
-        const unsigned long scheduledUptimeMillis;
+#ifdef TASK_CALLBACK_INDEX_SIZE
+        uintptr_t callbackKey() {
+          if (isCallbackTask) {
+#ifdef CONTEXT_CALLBACKS
+            return (uintptr_t)((CallbackTask*)this)->callback ^ (uintptr_t)((CallbackTask*)this)->context;
+#else
+            return (uintptr_t)((CallbackTask*)this)->callback;
+#endif
+          } else {
+            return (uintptr_t)((RunnableTask*)this)->runnable;
+          }
+        }
+#endif
+#ifdef TASK_POOL_SIZE
+        // allocate from the task pool, returns NULL if it is exhausted
+        static void *operator new(size_t size) noexcept;
+        // must be called with interrupts disabled
+        static void operator delete(void *task) noexcept;
+#endif
+        unsigned long scheduledUptimeMillis;
         // dynamic_cast is not supported by default as it compiles with -fno-rtti
         // Therefore, we use this variable to detect which Task type it is.
         const bool isCallbackTask;
+#ifdef PERIODIC_TASKS
+        /**
+          0 for tasks that run once
+        */
+        unsigned long periodMillis;
+        bool fixedRate;
+#endif
+#ifdef TIMER_SLACK
+        unsigned long toleranceMillis;
+#endif
+#if defined(TASK_QUEUE_HEAP) || defined(TASK_QUEUE_TIMING_WHEEL)
+        /**
+          order of insertion, used to run tasks with the same time in FIFO order
+        */
+        unsigned long sequence;
+#endif
+#if defined(TASK_QUEUE_HEAP) || defined(TASK_QUEUE_TIMING_WHEEL) || defined(TASK_READY_LISTS)
+        bool atFrontOfQueue;
+#endif
+#if !defined(TASK_QUEUE_HEAP) || defined(TASK_READY_LISTS) || defined(SCHEDULE_BATCH) || defined(ESP32_DUAL_CORE)
+        /**
+          next task in the run queue, in a ready list, in the batch of scheduleBatch()
+          or in the queue of the second core
+        */
         Task *next;
+#endif
+#ifdef TASK_PRIORITIES
+        byte priority;
+#endif
+#ifdef TASK_DEADLINES
+        /**
+          time in milliseconds after scheduledUptimeMillis until the task must have finished, 0 for none
+        */
+        unsigned long deadlineMillis;
+#endif
+#ifdef TASK_READY_LISTS
+        /**
+          true while the task is in a ready list instead of the run queue
+        */
+        bool ready;
+#endif
+#ifdef ESP32_DUAL_CORE
+        byte core;
+        /**
+          true while the task waits in the queue of the second core, it then counts as running
+        */
+        bool handedOver;
+#endif
+#if defined(TASK_QUEUE_TIMING_WHEEL) || defined(TASK_QUEUE_LIST_PREVIOUS)
+        Task *previous;
+#endif
+#ifdef TASK_QUEUE_TIMING_WHEEL
+        /**
+          the list of the wheel the task is in
+        */
+        byte wheelSlot;
+#endif
+#ifdef TASK_QUEUE_HEAP
+        unsigned int heapIndex;
+#endif
+#ifdef TASK_CALLBACK_INDEX_SIZE
+        /**
+          list of the tasks with the same callback
+        */
+        Task *indexNext;
+        Task *indexPrevious;
+#endif
     };
     class CallbackTask: public Task {
       public:
         CallbackTask(void (*callback)(), const unsigned long scheduledUptimeMillis)
           : Task(scheduledUptimeMillis, true), callback(callback) {
+#ifdef CONTEXT_CALLBACKS
+          context = NULL;
+          hasContext = false;
+#endif
         }
+#ifdef CONTEXT_CALLBACKS
+        CallbackTask(void (*callback)(void*), void *context, const unsigned long scheduledUptimeMillis)
+          : Task(scheduledUptimeMillis, true), callback((void (*)()) callback) {
+          this->context = context;
+          hasContext = true;
+        }
+#endif
         void (* const callback)();
+#ifdef CONTEXT_CALLBACKS
+        /**
+          passed to the callback if hasContext is set, callback is a void (*)(void*) then
+        */
+        void *context;
+        bool hasContext;
+#endif
     };
     class RunnableTask: public Task {
       public:
@@ -284,6 +1164,100 @@ class Scheduler {
         }
         Runnable * const runnable;
     };
+#ifdef CONTEXT_CALLBACKS
+    /**
+      callback of the schedule methods for a method, calls it on the object passed as context
+    */
+    template <class T, void (T::*method)()> static void methodCallback(void *object) {
+      (static_cast<T*>(object)->*method)();
+    }
+#endif
+#ifdef TASK_POOL_SIZE
+    union TaskPoolEntry {
+      TaskPoolEntry *nextFree;
+      byte callbackTask[sizeof(CallbackTask)];
+      byte runnableTask[sizeof(RunnableTask)];
+    };
+    /**
+      storage of all tasks, unused entries are linked in taskPoolFree
+    */
+    static TaskPoolEntry taskPool[TASK_POOL_SIZE];
+    static TaskPoolEntry *taskPoolFree;
+    static unsigned int taskPoolOverflowCount;
+#endif
+#ifdef TASK_HANDLES
+    /**
+      increased when a task of the pool is deleted so that its handles become invalid
+    */
+    static uint16_t taskPoolGeneration[TASK_POOL_SIZE];
+    void insertTaskWithHandle(Task *newTask, TaskHandle &handle);
+    // These methods are called with interrupts disabled
+    inline Task *handleToTask(const TaskHandle &handle) const;
+    inline bool isTaskStarted(Task *task) const;
+    inline bool rescheduleTask(Task *task, const unsigned long uptimeMillis);
+#endif
+
+#ifdef TIMER_SLACK
+    // visitors used with queueVisitUntil()
+    struct WakeupVisitor {
+      unsigned long limit;
+      void visit(Task *task) {
+        const unsigned long latestMillis = task->scheduledUptimeMillis + task->toleranceMillis;
+        if (timeBefore(latestMillis, limit)) {
+          limit = latestMillis;
+        }
+      }
+    };
+    struct SavedWakeupVisitor {
+      unsigned long limit;
+      unsigned long firstMillis;
+      unsigned long count;
+      void visit(Task *task) {
+        if (timeBefore(firstMillis, task->scheduledUptimeMillis)) {
+          count++;
+        }
+      }
+    };
+    void insertTaskWithTolerance(Task *newTask, const unsigned long toleranceMillis);
+    inline void countSavedWakeups(const unsigned long wakeupMillis);
+    unsigned long savedWakeupCount;
+    /**
+      wakeup time counted last in savedWakeupCount
+    */
+    unsigned long savedWakeupMillis;
+#endif
+    inline unsigned long nextWakeupMillis();
+
+#ifdef TASK_STATS_SIZE
+    TaskStats taskStats[TASK_STATS_SIZE];
+    byte taskStatsCount;
+    unsigned int taskStatsOverflowCount;
+    inline void recordTaskStats(Task *task, const unsigned long runMicros, const unsigned long latenessMillis);
+#endif
+
+    /**
+      Compares two uptimes in a way that is still correct after they wrapped
+      as long as they are less than 24.8 days apart.
+    */
+    static inline bool timeBefore(const unsigned long millis, const unsigned long otherMillis) {
+      // int32_t instead of long, so it also works where long has 64 bits, e.g. in the host simulation
+      return (int32_t) (millis - otherMillis) < 0;
+    }
+    /**
+      The time from earlierTime to laterTime, also after they wrapped. Like timeBefore(), it is
+      calculated with 32 bits, so it also works where unsigned long has 64 bits.
+    */
+    static inline unsigned long timeDifference(const unsigned long laterTime, const unsigned long earlierTime) {
+      return (uint32_t) (laterTime - earlierTime);
+    }
+    /**
+      upper 32 bits of getMillis64()
+    */
+    unsigned long millisEpoch;
+    /**
+      the last value of getMillis() used to detect when it wraps
+    */
+    unsigned long millisEpochLast;
 
     /**
       controls if sleep is done, 0 does sleep
@@ -292,7 +1266,19 @@ class Scheduler {
 
     void insertTask(Task *task);
     void insertTaskAndRemoveExisting(Task *newTask);
-    void deleteTask(Task *taskToDelete, Task *previousTask);
+    void insertTaskAtFrontOfQueue(Task *newTask);
+    inline bool addTask(Task *newTask, const bool atFrontOfQueue);
+#ifdef SCHEDULE_BATCH
+    inline void addTaskBatch(Task *batch);
+#endif
+    inline void unlinkTask(Task *task);
+    inline bool containsEqualTask(Task *task) const;
+    inline void removeEqualTasks(Task *task);
+#ifdef PERIODIC_TASKS
+    void insertPeriodicTask(Task *newTask, const unsigned long periodMillis, const bool fixedRate);
+    inline void reschedulePeriodicTask(Task *task, const unsigned long currentMillis);
+    unsigned long skippedPeriodCount;
+#endif
 
   private:
     enum SleepMode {
@@ -309,10 +1295,6 @@ class Scheduler {
       currently set task timeout
     */
     TaskTimeout taskTimeout;
-    /**
-      first element in the run queue
-    */
-    Task *first;
     /*
       the task currently running or null if none running
     */
@@ -325,8 +1307,72 @@ class Scheduler {
     unsigned long lastTaskFinishedMillis;
 #endif
 
+#ifdef SLEEP_STATS
+    /**
+      getMillis() when the statistics were reset, the time awake is calculated from it
+    */
+    unsigned long sleepStatsStartMillis;
+    unsigned long sleepStatsIdleMillis;
+    /**
+      static as the WDT interrupt adds the sleep time on AVR
+    */
+    static volatile unsigned long sleepStatsSleepMillis;
+    unsigned long sleepStatsTimerWakeupCount;
+    unsigned long sleepStatsInterruptWakeupCount;
+    // called by the platform implementation on the main thread after the CPU woke up
+    inline void sleepStatsAddTime(const SleepMode sleepMode, const unsigned long durationMillis);
+    inline void sleepStatsAddWakeup(const bool byTimer);
+#endif
+
+#ifdef TRACE_BUFFER_SIZE
+    // Events of the trace, the numbers are used by extras/trace_decoder.py
+    enum TraceEvent {
+      TRACE_SCHEDULE = 1,
+      TRACE_TASK_START = 2,
+      TRACE_TASK_END = 3,
+      TRACE_SLEEP_ENTER = 4,
+      TRACE_SLEEP_EXIT = 5,
+      TRACE_SUPERVISION_TIMEOUT = 6
+    };
+    // flags in the arg of the task events
+#define TRACE_FLAG_RUNNABLE 1
+#define TRACE_FLAG_FROM_INTERRUPT 2
+    struct TraceRecord {
+      /**
+        uptime as returned by getMillis()
+      */
+      unsigned long millis;
+      byte event;
+      byte arg;
+      /**
+        lower 16 bits of the callback or Runnable for task events, milliseconds for sleep events
+      */
+      uint16_t data;
+    };
+    // static as the supervision interrupt records as well
+    static TraceRecord traceBuffer[TRACE_BUFFER_SIZE];
+    static unsigned int traceHead;
+    static unsigned int traceCount;
+    /**
+      number of events overwritten before they were printed
+    */
+    static unsigned long traceLostCount;
+    /**
+      set while submissionRingDrain() schedules the tasks added by scheduleFromInterrupt()
+    */
+    bool traceFromInterrupt;
+    // These methods are called with interrupts disabled.
+    static inline void traceRecord(const byte event, const byte arg, const unsigned long data);
+    inline void traceTask(const byte event, Task *task);
+    // uptime like getMillis() but without enabling interrupts, defined by the platform implementation
+    static inline unsigned long traceMillis();
+#endif
+
     inline void setupTaskTimeoutIfConfigured();
     inline bool executeNextIfTime();
+    // Called with interrupts disabled.
+    inline Task *removeFirstDueTask(const unsigned long currentMillis);
+    inline void runTask(Task *&running);
     inline void reactivateTaskTimeoutIfRequired();
 
     // These methods MUST be defined by the definition include
@@ -340,15 +1386,119 @@ class Scheduler {
     //
     // // only used for AVR
     // void wdtEnableInterrupt();
-#if defined(ESP32) || defined(ESP8266)
+#if !defined(ARDUINO)
+#include "DeepSleepScheduler_host_definition.h"
+#elif defined(ESP32) || defined(ESP8266)
 #include "DeepSleepScheduler_esp_definition.h"
+#elif defined(AVR_TIMER2_SLEEP)
+#include "DeepSleepScheduler_avr_timer2_definition.h"
 #else
 #include "DeepSleepScheduler_avr_definition.h"
+#endif
+
+    // These methods MUST be defined by the run queue definition include.
+    // They are called with interrupts disabled.
+    // void queueInit();
+    // bool queueIsEmpty() const;
+    // // the task scheduled first or NULL if the queue is empty
+    // Task *queuePeek() const;
+    // // remove and return the first task if its time is reached, NULL otherwise
+    // Task *queueRemoveFirstIfDue(const unsigned long currentMillis);
+    // // insert ordered by time and after tasks with the same time, false if the queue is full
+    // bool queueInsert(Task *task);
+    // bool queueInsertAtFront(Task *task);
+    // // like queueInsert() but previousTask, if not NULL, is in the queue and not after the task
+    // bool queueInsertAfter(Task *task, Task *previousTask);
+    // bool queueContainsEqual(Task *task) const;
+    // // remove and delete all tasks with the same callback
+    // void queueRemoveEqual(Task *task);
+    // // remove the task without deleting it
+    // void queueRemove(Task *task);
+    // // call visitor.visit() at least for all tasks with a time up to visitor.limit
+    // template <class Visitor> void queueVisitUntil(Visitor &visitor);
+#ifdef TASK_QUEUE_HEAP
+#include "DeepSleepScheduler_heap_definition.h"
+#elif defined(TASK_QUEUE_TIMING_WHEEL)
+#include "DeepSleepScheduler_wheel_definition.h"
+#else
+#include "DeepSleepScheduler_list_definition.h"
+#endif
+#ifdef TASK_CALLBACK_INDEX_SIZE
+#include "DeepSleepScheduler_index_definition.h"
+#endif
+#ifdef SUBMISSION_RING_SIZE
+#include "DeepSleepScheduler_ring_definition.h"
+#endif
+#ifdef TASK_READY_LISTS
+#include "DeepSleepScheduler_ready_definition.h"
 #endif
 };
 
 extern Scheduler scheduler;
 
+#ifdef RESUMABLE_TASKS
+/**
+  Extend from ResumableRunnable in order to write a sequence with waits in one run() method.
+  RESUMABLE_SLEEP_FOR() returns from run() and schedules it again, the next run continues
+  after the macro. In the meantime, other tasks run or the CPU sleeps.
+  The stack is not kept, so local variables lose their value. Use member variables instead.
+  Do not use the macros in a switch statement and not more than one per line.
+
+  class Measure: public ResumableRunnable {
+    public:
+      virtual void run() {
+        RESUMABLE_BEGIN();
+        digitalWrite(SENSOR_POWER_PIN, HIGH);
+        RESUMABLE_SLEEP_FOR(200);
+        value = analogRead(SENSOR_PIN);
+        digitalWrite(SENSOR_POWER_PIN, LOW);
+        RESUMABLE_END();
+      }
+  };
+*/
+class ResumableRunnable: public Runnable {
+  public:
+    ResumableRunnable() : resumeLine(0) {
+    }
+    /**
+      Schedules run() to start from the beginning and removes a pending continuation.
+    */
+    void start() {
+      scheduler.removeCallbacks(this);
+      resumeLine = 0;
+      scheduler.schedule(this);
+    }
+    /**
+      return: true if run() started and did not reach RESUMABLE_END() yet.
+    */
+    bool isRunning() const {
+      return resumeLine != 0;
+    }
+  protected:
+    /**
+      the line of the macro where run() continues, 0 to start from the beginning
+    */
+    unsigned int resumeLine;
+};
+
+/**
+  Start of the resumable part of run(), must be the first statement.
+*/
+#define RESUMABLE_BEGIN() switch (resumeLine) { case 0:
+/**
+  Returns from run() and continues after the macro in delayMillis milliseconds.
+*/
+#define RESUMABLE_SLEEP_FOR(delayMillis) do { resumeLine = __LINE__; scheduler.scheduleDelayed(this, delayMillis); return; case __LINE__:; } while (0)
+/**
+  Returns from run() to let the tasks run that are due and continues after the macro.
+*/
+#define RESUMABLE_YIELD() do { resumeLine = __LINE__; scheduler.schedule(this); return; case __LINE__:; } while (0)
+/**
+  End of the resumable part of run(), the next run starts from the beginning.
+*/
+#define RESUMABLE_END() } resumeLine = 0
+#endif
+
 #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
 // -------------------------------------------------------------------------------------------------
 // Implementation (usuallly in CPP file)
@@ -362,15 +1512,79 @@ Scheduler scheduler;
 Runnable *Scheduler::supervisionCallbackRunnable;
 #endif
 
+#ifdef TASK_POOL_SIZE
+Scheduler::TaskPoolEntry Scheduler::taskPool[TASK_POOL_SIZE];
+Scheduler::TaskPoolEntry *Scheduler::taskPoolFree;
+unsigned int Scheduler::taskPoolOverflowCount;
+#endif
+#ifdef TASK_HANDLES
+uint16_t Scheduler::taskPoolGeneration[TASK_POOL_SIZE];
+#endif
+
+#ifdef SLEEP_STATS
+volatile unsigned long Scheduler::sleepStatsSleepMillis;
+#endif
+
+#ifdef TRACE_BUFFER_SIZE
+Scheduler::TraceRecord Scheduler::traceBuffer[TRACE_BUFFER_SIZE];
+unsigned int Scheduler::traceHead;
+unsigned int Scheduler::traceCount;
+unsigned long Scheduler::traceLostCount;
+#endif
+
 Scheduler::Scheduler() {
 #ifdef AWAKE_INDICATION_PIN
   pinMode(AWAKE_INDICATION_PIN, OUTPUT);
 #endif
   taskTimeout = TIMEOUT_8S;
 
-  first = NULL;
+  queueInit();
+#ifdef TASK_CALLBACK_INDEX_SIZE
+  indexInit();
+#endif
+#ifdef SUBMISSION_RING_SIZE
+  submissionRingInit();
+#endif
+#ifdef TASK_READY_LISTS
+  readyInit();
+#endif
   current = NULL;
   noSleepLocksCount = 0;
+  millisEpoch = 0;
+  millisEpochLast = 0;
+#ifdef TASK_STATS_SIZE
+  taskStatsCount = 0;
+  taskStatsOverflowCount = 0;
+#endif
+#ifdef SLEEP_STATS
+  sleepStatsStartMillis = 0;
+  sleepStatsIdleMillis = 0;
+  sleepStatsSleepMillis = 0;
+  sleepStatsTimerWakeupCount = 0;
+  sleepStatsInterruptWakeupCount = 0;
+#endif
+#ifdef TRACE_BUFFER_SIZE
+  traceHead = 0;
+  traceCount = 0;
+  traceLostCount = 0;
+  traceFromInterrupt = false;
+#endif
+#ifdef PERIODIC_TASKS
+  skippedPeriodCount = 0;
+#endif
+#ifdef TIMER_SLACK
+  savedWakeupCount = 0;
+  savedWakeupMillis = 0;
+#endif
+
+#ifdef TASK_POOL_SIZE
+  taskPoolFree = NULL;
+  for (int i = TASK_POOL_SIZE - 1; i >= 0; i--) {
+    taskPool[i].nextFree = taskPoolFree;
+    taskPoolFree = &taskPool[i];
+  }
+  taskPoolOverflowCount = 0;
+#endif
 
   init();
 }
@@ -415,108 +1629,203 @@ void Scheduler::scheduleAt(Runnable *runnable, unsigned long uptimeMillis) {
   insertTask(newTask);
 }
 
-void Scheduler::scheduleAtFrontOfQueue(void (*callback)()) {
-  Task *newTask = new CallbackTask(callback, getMillis());
+#ifdef CONTEXT_CALLBACKS
+void Scheduler::schedule(void (*callback)(void*), void *context) {
+  Task *newTask = new CallbackTask(callback, context, getMillis());
+  insertTask(newTask);
+}
+
+void Scheduler::scheduleOnce(void (*callback)(void*), void *context) {
+  Task *newTask = new CallbackTask(callback, context, getMillis());
+  insertTaskAndRemoveExisting(newTask);
+}
+
+void Scheduler::scheduleDelayed(void (*callback)(void*), void *context, unsigned long delayMillis) {
+  Task *newTask = new CallbackTask(callback, context, getMillis() + delayMillis);
+  insertTask(newTask);
+}
+
+void Scheduler::scheduleAt(void (*callback)(void*), void *context, unsigned long uptimeMillis) {
+  Task *newTask = new CallbackTask(callback, context, uptimeMillis);
+  insertTask(newTask);
+}
+
+bool Scheduler::isScheduled(void (*callback)(void*), void *context) const {
+  // only used to compare the callback and the context
+  CallbackTask task(callback, context, 0);
   noInterrupts();
-  newTask->next = first;
-  first = newTask;
+  bool scheduled = containsEqualTask(&task);
   interrupts();
+  return scheduled;
 }
 
-void Scheduler::scheduleAtFrontOfQueue(Runnable *runnable) {
-  Task *newTask = new RunnableTask(runnable, getMillis());
+void Scheduler::removeCallbacks(void (*callback)(void*), void *context) {
+  // only used to compare the callback and the context
+  CallbackTask task(callback, context, 0);
   noInterrupts();
-  newTask->next = first;
-  first = newTask;
+  removeEqualTasks(&task);
   interrupts();
 }
+#endif
 
-bool Scheduler::isScheduled(void (*callback)()) const {
-  bool scheduled = false;
+#ifdef TIMER_SLACK
+void Scheduler::scheduleDelayed(void (*callback)(), unsigned long delayMillis, unsigned long toleranceMillis) {
+  Task *newTask = new CallbackTask(callback, getMillis() + delayMillis);
+  insertTaskWithTolerance(newTask, toleranceMillis);
+}
+
+void Scheduler::scheduleDelayed(Runnable *runnable, unsigned long delayMillis, unsigned long toleranceMillis) {
+  Task *newTask = new RunnableTask(runnable, getMillis() + delayMillis);
+  insertTaskWithTolerance(newTask, toleranceMillis);
+}
+
+void Scheduler::scheduleAt(void (*callback)(), unsigned long uptimeMillis, unsigned long toleranceMillis) {
+  Task *newTask = new CallbackTask(callback, uptimeMillis);
+  insertTaskWithTolerance(newTask, toleranceMillis);
+}
+
+void Scheduler::scheduleAt(Runnable *runnable, unsigned long uptimeMillis, unsigned long toleranceMillis) {
+  Task *newTask = new RunnableTask(runnable, uptimeMillis);
+  insertTaskWithTolerance(newTask, toleranceMillis);
+}
+
+unsigned long Scheduler::getSavedWakeupCount() const {
   noInterrupts();
-  Task *currentTask = first;
-  while (currentTask != NULL) {
-    if (currentTask->isCallbackTask && ((CallbackTask*)currentTask)->callback == callback) {
-      scheduled = true;
-      break;
+  const unsigned long count = savedWakeupCount;
+  interrupts();
+  return count;
+}
+#endif
+
+#ifdef PERIODIC_TASKS
+void Scheduler::scheduleFixedRate(void (*callback)(), unsigned long initialDelayMillis, unsigned long periodMillis) {
+  Task *newTask = new CallbackTask(callback, getMillis() + initialDelayMillis);
+  insertPeriodicTask(newTask, periodMillis, true);
+}
+
+void Scheduler::scheduleFixedRate(Runnable *runnable, unsigned long initialDelayMillis, unsigned long periodMillis) {
+  Task *newTask = new RunnableTask(runnable, getMillis() + initialDelayMillis);
+  insertPeriodicTask(newTask, periodMillis, true);
+}
+
+void Scheduler::scheduleFixedDelay(void (*callback)(), unsigned long initialDelayMillis, unsigned long delayMillis) {
+  Task *newTask = new CallbackTask(callback, getMillis() + initialDelayMillis);
+  insertPeriodicTask(newTask, delayMillis, false);
+}
+
+void Scheduler::scheduleFixedDelay(Runnable *runnable, unsigned long initialDelayMillis, unsigned long delayMillis) {
+  Task *newTask = new RunnableTask(runnable, getMillis() + initialDelayMillis);
+  insertPeriodicTask(newTask, delayMillis, false);
+}
+
+unsigned long Scheduler::getSkippedPeriodCount() const {
+  noInterrupts();
+  const unsigned long count = skippedPeriodCount;
+  interrupts();
+  return count;
+}
+#endif
+
+void Scheduler::scheduleAtFrontOfQueue(void (*callback)()) {
+  Task *newTask = new CallbackTask(callback, getMillis());
+  insertTaskAtFrontOfQueue(newTask);
+}
+
+void Scheduler::scheduleAtFrontOfQueue(Runnable *runnable) {
+  Task *newTask = new RunnableTask(runnable, getMillis());
+  insertTaskAtFrontOfQueue(newTask);
+}
+
+#ifdef SCHEDULE_BATCH
+void Scheduler::scheduleBatch(const ScheduleBatchEntry *entries, const byte count) {
+  const unsigned long currentMillis = getMillis();
+  // sort by insertion before interrupts are disabled, batches are small
+  Task *batch = NULL;
+  for (byte i = 0; i < count; i++) {
+    Task *newTask = new CallbackTask(entries[i].callback, currentMillis + entries[i].delayMillis);
+    if (newTask == NULL) {
+      // out of memory
+      continue;
     }
-    currentTask = currentTask->next;
+    Task **position = &batch;
+    while (*position != NULL && !timeBefore(newTask->scheduledUptimeMillis, (*position)->scheduledUptimeMillis)) {
+      position = &(*position)->next;
+    }
+    newTask->next = *position;
+    *position = newTask;
   }
+  noInterrupts();
+  addTaskBatch(batch);
+  interrupts();
+}
+#endif
+
+bool Scheduler::isScheduled(void (*callback)()) const {
+  // only used to compare the callback
+  CallbackTask task(callback, 0);
+  noInterrupts();
+  bool scheduled = containsEqualTask(&task);
   interrupts();
   return scheduled;
 }
 
 bool Scheduler::isScheduled(Runnable *runnable) const {
-  bool scheduled = false;
+  // only used to compare the runnable
+  RunnableTask task(runnable, 0);
   noInterrupts();
-  Task *currentTask = first;
-  while (currentTask != NULL) {
-    if (!currentTask->isCallbackTask && ((RunnableTask*)currentTask)->runnable == runnable) {
-      scheduled = true;
-      break;
-    }
-    currentTask = currentTask->next;
-  }
+  bool scheduled = containsEqualTask(&task);
   interrupts();
   return scheduled;
 }
 
 unsigned long Scheduler::getScheduleTimeOfCurrentTask() const {
+  unsigned long scheduledUptimeMillis = 0;
   noInterrupts();
-  if (current != NULL) {
-    return current->scheduledUptimeMillis;
+#ifdef ESP32_DUAL_CORE
+  Task *task = xPortGetCoreID() == mainCore ? current : workerCurrent;
+#else
+  Task *task = current;
+#endif
+  if (task != NULL) {
+    scheduledUptimeMillis = task->scheduledUptimeMillis;
   }
   interrupts();
-  return 0;
+  return scheduledUptimeMillis;
 }
 
-void Scheduler::removeCallbacks(void (*callback)()) {
+uint64_t Scheduler::getMillis64() {
+  const unsigned long currentMillis = getMillis();
   noInterrupts();
-  if (first != NULL) {
-    Task *previousTask = NULL;
-    Task *currentTask = first;
-    while (currentTask != NULL) {
-      if (currentTask->isCallbackTask && ((CallbackTask*)currentTask)->callback == callback) {
-        Task *taskToDelete = currentTask;
-        if (previousTask == NULL) {
-          // remove the first task
-          first = taskToDelete->next;
-        } else {
-          previousTask->next = taskToDelete->next;
-        }
-        currentTask = taskToDelete->next;
-        delete taskToDelete;
-      } else {
-        previousTask = currentTask;
-        currentTask = currentTask->next;
-      }
+  unsigned long epoch = millisEpoch;
+  if (!timeBefore(currentMillis, millisEpochLast)) {
+    if (currentMillis < millisEpochLast) {
+      // getMillis() wrapped since the last call
+      epoch++;
+      millisEpoch = epoch;
     }
+    millisEpochLast = currentMillis;
+  } else if (currentMillis > millisEpochLast && epoch != 0) {
+    // an interrupt updated the epoch after getMillis() was read before it wrapped
+    epoch--;
   }
   interrupts();
+  // the cast keeps the lower 32 bits where unsigned long has 64 bits, e.g. in the host simulation
+  return ((uint64_t) epoch << 32) | (uint32_t) currentMillis;
+}
+
+void Scheduler::removeCallbacks(void (*callback)()) {
+  // only used to compare the callback
+  CallbackTask task(callback, 0);
+  noInterrupts();
+  removeEqualTasks(&task);
+  interrupts();
 }
 
 void Scheduler::removeCallbacks(Runnable *runnable) {
+  // only used to compare the runnable
+  RunnableTask task(runnable, 0);
   noInterrupts();
-  if (first != NULL) {
-    Task *previousTask = NULL;
-    Task *currentTask = first;
-    while (currentTask != NULL) {
-      if (!currentTask->isCallbackTask && ((RunnableTask*)currentTask)->runnable == runnable) {
-        Task *taskToDelete = currentTask;
-        if (previousTask == NULL) {
-          // remove the first task
-          first = taskToDelete->next;
-        } else {
-          previousTask->next = taskToDelete->next;
-        }
-        currentTask = taskToDelete->next;
-        delete taskToDelete;
-      } else {
-        previousTask = currentTask;
-        currentTask = currentTask->next;
-      }
-    }
-  }
+  removeEqualTasks(&task);
   interrupts();
 }
 
@@ -542,123 +1851,689 @@ void Scheduler::setTaskTimeout(TaskTimeout taskTimeout) {
 
 // Inserts a new task in the ordered lists of tasks.
 void Scheduler::insertTask(Task *newTask) {
+  if (newTask == NULL) {
+    // out of memory
+    return;
+  }
   noInterrupts();
-  if (first == NULL) {
-    first = newTask;
-  } else {
-    if (first->scheduledUptimeMillis > newTask->scheduledUptimeMillis) {
-      // insert before first
-      newTask->next = first;
-      first = newTask;
+  addTask(newTask, false);
+  interrupts();
+}
+
+// Inserts a new task in the ordered lists of tasks and remove all existing tasks with the same callback
+void Scheduler::insertTaskAndRemoveExisting(Task *newTask) {
+  if (newTask == NULL) {
+    // out of memory
+    return;
+  }
+  noInterrupts();
+  removeEqualTasks(newTask);
+  addTask(newTask, false);
+  interrupts();
+}
+
+void Scheduler::insertTaskAtFrontOfQueue(Task *newTask) {
+  if (newTask == NULL) {
+    // out of memory
+    return;
+  }
+  noInterrupts();
+  addTask(newTask, true);
+  interrupts();
+}
+
+// Adds the task to the run queue or deletes it if there is no space left and returns false.
+// Called with interrupts disabled.
+bool Scheduler::addTask(Task *newTask, const bool atFrontOfQueue) {
+#ifdef TASK_CALLBACK_INDEX_SIZE
+  if (!indexAdd(newTask)) {
+    delete newTask;
+    return false;
+  }
+#endif
+#ifdef TASK_READY_LISTS
+  newTask->atFrontOfQueue = atFrontOfQueue;
+#endif
+  const bool inserted = atFrontOfQueue ? queueInsertAtFront(newTask) : queueInsert(newTask);
+#ifdef TRACE_BUFFER_SIZE
+  if (inserted) {
+    traceTask(TRACE_SCHEDULE, newTask);
+  }
+#endif
+  if (!inserted) {
+#ifdef TASK_CALLBACK_INDEX_SIZE
+    indexRemove(newTask);
+#endif
+    delete newTask;
+  }
+  return inserted;
+}
+
+#ifdef SCHEDULE_BATCH
+// Adds the tasks of the batch, linked by next and sorted by time, to the run queue.
+// Each task is inserted after the previous one, so the run queue is passed once.
+// Called with interrupts disabled.
+void Scheduler::addTaskBatch(Task *batch) {
+  Task *previousTask = NULL;
+  while (batch != NULL) {
+    Task *newTask = batch;
+    batch = newTask->next;
+#ifdef TASK_CALLBACK_INDEX_SIZE
+    if (!indexAdd(newTask)) {
+      delete newTask;
+      continue;
+    }
+#endif
+#ifdef TASK_READY_LISTS
+    newTask->atFrontOfQueue = false;
+#endif
+    if (queueInsertAfter(newTask, previousTask)) {
+#ifdef TRACE_BUFFER_SIZE
+      traceTask(TRACE_SCHEDULE, newTask);
+#endif
+      previousTask = newTask;
     } else {
-      Task *previousTask = first;
-      while (previousTask->next != NULL
-             && previousTask->next->scheduledUptimeMillis <= newTask->scheduledUptimeMillis) {
-        previousTask = previousTask->next;
-      }
-      // insert after previousTask
-      newTask->next = previousTask->next;
-      previousTask->next = newTask;
+#ifdef TASK_CALLBACK_INDEX_SIZE
+      indexRemove(newTask);
+#endif
+      delete newTask;
     }
   }
+}
+#endif
+
+// Removes the task from the run queue or its ready list without deleting it.
+// Called with interrupts disabled.
+void Scheduler::unlinkTask(Task *task) {
+#ifdef TASK_READY_LISTS
+  if (task->ready) {
+    readyRemove(task);
+    return;
+  }
+#endif
+  queueRemove(task);
+}
+
+// Called with interrupts disabled.
+bool Scheduler::containsEqualTask(Task *task) const {
+#ifdef TASK_CALLBACK_INDEX_SIZE
+  return indexContainsEqual(task);
+#elif defined(TASK_READY_LISTS)
+  return queueContainsEqual(task) || readyContainsEqual(task);
+#else
+  return queueContainsEqual(task);
+#endif
+}
+
+// Removes and deletes all tasks with the same callback. Called with interrupts disabled.
+void Scheduler::removeEqualTasks(Task *task) {
+#ifdef TASK_CALLBACK_INDEX_SIZE
+  indexRemoveEqual(task);
+#else
+  queueRemoveEqual(task);
+#ifdef TASK_READY_LISTS
+  readyRemoveEqual(task);
+#endif
+#endif
+#ifdef PERIODIC_TASKS
+  if (current != NULL && current->equalCallback(task)) {
+    // a periodic task is removed while it runs, do not schedule it again
+    current->periodMillis = 0;
+  }
+#ifdef ESP32_DUAL_CORE
+  workerStopPeriodic(task);
+#endif
+#endif
+}
+
+#ifdef TIMER_SLACK
+void Scheduler::insertTaskWithTolerance(Task *newTask, const unsigned long toleranceMillis) {
+  if (newTask == NULL) {
+    // out of memory
+    return;
+  }
+  newTask->toleranceMillis = toleranceMillis;
+  insertTask(newTask);
+}
+
+// Counts the tasks that run in the wakeup at wakeupMillis but are scheduled after the first one.
+// Called with interrupts disabled before the CPU enters sleep.
+void Scheduler::countSavedWakeups(const unsigned long wakeupMillis) {
+  if (wakeupMillis == savedWakeupMillis) {
+    // already counted, e.g. when the sleep is continued after a WDT interrupt
+    return;
+  }
+  savedWakeupMillis = wakeupMillis;
+  SavedWakeupVisitor visitor;
+  visitor.limit = wakeupMillis;
+  visitor.firstMillis = queuePeek()->scheduledUptimeMillis;
+  visitor.count = 0;
+  queueVisitUntil(visitor);
+  savedWakeupCount += visitor.count;
+}
+#endif
+
+// Returns the time when the CPU needs to wake up for the next task. With TIMER_SLACK, this is the
+// latest time within the tolerance of all tasks that are scheduled before it, so that
+// they all run in the same wakeup. Called with interrupts disabled and a non-empty queue.
+unsigned long Scheduler::nextWakeupMillis() {
+  Task *firstTask = queuePeek();
+#ifdef TIMER_SLACK
+  WakeupVisitor visitor;
+  visitor.limit = firstTask->scheduledUptimeMillis + firstTask->toleranceMillis;
+  queueVisitUntil(visitor);
+  return visitor.limit;
+#else
+  return firstTask->scheduledUptimeMillis;
+#endif
+}
+
+#ifdef PERIODIC_TASKS
+void Scheduler::insertPeriodicTask(Task *newTask, const unsigned long periodMillis, const bool fixedRate) {
+  if (newTask == NULL) {
+    // out of memory
+    return;
+  }
+  newTask->periodMillis = periodMillis;
+  newTask->fixedRate = fixedRate;
+  insertTask(newTask);
+}
+
+// Calculates the next time of the periodic task and inserts it again. Called with interrupts disabled.
+void Scheduler::reschedulePeriodicTask(Task *task, const unsigned long currentMillis) {
+  if (task->fixedRate) {
+    // number of further periods whose whole slot passed since the scheduled time,
+    // the period in which the run finished still runs, just late
+    unsigned long skippedPeriods = 0;
+    const unsigned long sinceScheduledMillis = timeDifference(currentMillis, task->scheduledUptimeMillis);
+    if (!timeBefore(currentMillis, task->scheduledUptimeMillis) && sinceScheduledMillis >= task->periodMillis) {
+      skippedPeriods = sinceScheduledMillis / task->periodMillis - 1;
+    }
+    skippedPeriodCount += skippedPeriods;
+    task->scheduledUptimeMillis += (skippedPeriods + 1) * task->periodMillis;
+  } else {
+    task->scheduledUptimeMillis = currentMillis + task->periodMillis;
+  }
+  addTask(task, false);
+}
+#endif
+
+#ifdef TASK_STATS_SIZE
+byte Scheduler::getTaskStatsCount() const {
+  noInterrupts();
+  const byte count = taskStatsCount;
   interrupts();
+  return count;
 }
 
-// Inserts a new task in the ordered lists of tasks and remove all existing tasks with the same callback
-void Scheduler::insertTaskAndRemoveExisting(Task *newTask) {
+bool Scheduler::getTaskStats(const byte index, TaskStats &stats) const {
+  noInterrupts();
+  const bool valid = index < taskStatsCount;
+  if (valid) {
+    stats = taskStats[index];
+  }
+  interrupts();
+  return valid;
+}
+
+void Scheduler::resetTaskStats() {
   noInterrupts();
+  taskStatsCount = 0;
+  taskStatsOverflowCount = 0;
+  interrupts();
+}
 
-  // remove first if it has the same callback as we insert
-  while (first != NULL && first->equalCallback(newTask)) {
-    deleteTask(first, NULL);
+unsigned int Scheduler::getTaskStatsOverflowCount() const {
+  noInterrupts();
+  const unsigned int count = taskStatsOverflowCount;
+  interrupts();
+  return count;
+}
+
+// Adds a run of the task to the entry of its callback. Called on the main thread after the task ran.
+void Scheduler::recordTaskStats(Task *task, const unsigned long runMicros, const unsigned long latenessMillis) {
+  void (*callback)() = NULL;
+  Runnable *runnable = NULL;
+  if (task->isCallbackTask) {
+    callback = ((CallbackTask*)task)->callback;
+  } else {
+    runnable = ((RunnableTask*)task)->runnable;
+  }
+  noInterrupts();
+  // the table is small, so a linear search is fast enough
+  byte index = 0;
+  while (index < taskStatsCount
+         && (taskStats[index].callback != callback || taskStats[index].runnable != runnable)) {
+    index++;
+  }
+  if (index == taskStatsCount) {
+    if (taskStatsCount == TASK_STATS_SIZE) {
+      taskStatsOverflowCount++;
+      interrupts();
+      return;
+    }
+    taskStatsCount++;
+    TaskStats &newStats = taskStats[index];
+    newStats.callback = callback;
+    newStats.runnable = runnable;
+    newStats.runCount = 0;
+    newStats.totalRunMicros = 0;
+    newStats.maxRunMicros = 0;
+    newStats.totalLatenessMillis = 0;
+    newStats.maxLatenessMillis = 0;
+  }
+  TaskStats &stats = taskStats[index];
+  stats.runCount++;
+  stats.totalRunMicros += runMicros;
+  if (runMicros > stats.maxRunMicros) {
+    stats.maxRunMicros = runMicros;
   }
-  // here first is not equal to the one we insert
+  stats.totalLatenessMillis += latenessMillis;
+  if (latenessMillis > stats.maxLatenessMillis) {
+    stats.maxLatenessMillis = latenessMillis;
+  }
+  interrupts();
+}
+#endif
+
+#ifdef SLEEP_STATS
+void Scheduler::getSleepStats(SleepStats &stats) const {
+  const unsigned long currentMillis = getMillis();
+  noInterrupts();
+  stats.idleMillis = sleepStatsIdleMillis;
+  stats.sleepMillis = sleepStatsSleepMillis;
+  stats.noSleepMillis = timeDifference(currentMillis, sleepStatsStartMillis) - sleepStatsIdleMillis - sleepStatsSleepMillis;
+  stats.timerWakeupCount = sleepStatsTimerWakeupCount;
+  stats.interruptWakeupCount = sleepStatsInterruptWakeupCount;
+  interrupts();
+}
+
+void Scheduler::resetSleepStats() {
+  const unsigned long currentMillis = getMillis();
+  noInterrupts();
+  sleepStatsStartMillis = currentMillis;
+  sleepStatsIdleMillis = 0;
+  sleepStatsSleepMillis = 0;
+  sleepStatsTimerWakeupCount = 0;
+  sleepStatsInterruptWakeupCount = 0;
+  interrupts();
+}
+
+#ifdef NO_SLEEP_CURRENT_MICROAMPS
+unsigned long Scheduler::getAverageCurrentMicroAmps() const {
+  SleepStats stats;
+  getSleepStats(stats);
+  const unsigned long totalMillis = stats.noSleepMillis + stats.idleMillis + stats.sleepMillis;
+  if (totalMillis == 0) {
+    return NO_SLEEP_CURRENT_MICROAMPS;
+  }
+  // 64 bit as the charge in micro ampere milliseconds overflows 32 bit within minutes
+  const uint64_t charge = (uint64_t) stats.noSleepMillis * NO_SLEEP_CURRENT_MICROAMPS
+                          + (uint64_t) stats.idleMillis * IDLE_CURRENT_MICROAMPS
+                          + (uint64_t) stats.sleepMillis * SLEEP_CURRENT_MICROAMPS;
+  return (unsigned long) (charge / totalMillis);
+}
+#endif
+
+void Scheduler::sleepStatsAddTime(const SleepMode sleepMode, const unsigned long durationMillis) {
+  noInterrupts();
+  if (sleepMode == SLEEP) {
+    sleepStatsSleepMillis += durationMillis;
+  } else if (sleepMode == IDLE) {
+    sleepStatsIdleMillis += durationMillis;
+  }
+  interrupts();
+}
 
-  if (first == NULL) {
-    first = newTask;
+void Scheduler::sleepStatsAddWakeup(const bool byTimer) {
+  if (byTimer) {
+    sleepStatsTimerWakeupCount++;
   } else {
-    if (first->scheduledUptimeMillis > newTask->scheduledUptimeMillis) {
-      // insert before first
-      newTask->next = first;
-      first = newTask;
-    } else {
-      Task *previousTask = first;
-      while (previousTask->next != NULL
-             && previousTask->next->scheduledUptimeMillis <= newTask->scheduledUptimeMillis) {
-        if (previousTask->next->equalCallback(newTask)) {
-          deleteTask(previousTask->next, previousTask);
-          // previousTask->next was deleted so we keep previousTask
-          // and will check the next previousTask->next on next loop
-        } else {
-          previousTask = previousTask->next;
-        }
-      }
-      // insert after previousTask
-      newTask->next = previousTask->next;
-      previousTask->next = newTask;
+    sleepStatsInterruptWakeupCount++;
+  }
+}
+#endif
+
+#ifdef TRACE_BUFFER_SIZE
+void Scheduler::dumpTrace(Print &output) {
+  // version of the format
+  output.println(F("TRACE 1"));
+  while (true) {
+    noInterrupts();
+    if (traceCount == 0) {
+      interrupts();
+      break;
     }
+    const unsigned int index = traceHead >= traceCount ? traceHead - traceCount : traceHead + TRACE_BUFFER_SIZE - traceCount;
+    const TraceRecord record = traceBuffer[index];
+    traceCount--;
+    interrupts();
 
-    // delete all existing tasks after the insert one
-    Task *previousTask = newTask;
-    while (previousTask->next != NULL) {
-      if (previousTask->next->equalCallback(newTask)) {
-        deleteTask(previousTask->next, previousTask);
-      } else {
-        previousTask = previousTask->next;
-      }
+    // millis, event, arg and data as 16 hexadecimal digits
+    char line[17];
+    const unsigned long values[] = {record.millis >> 16, record.millis & 0xFFFF,
+                                    ((unsigned int) record.event << 8) | record.arg, record.data
+                                   };
+    for (byte i = 0; i < 16; i++) {
+      const byte digit = (values[i / 4] >> ((3 - i % 4) * 4)) & 0xF;
+      line[i] = digit < 10 ? '0' + digit : 'a' + digit - 10;
     }
+    line[16] = '\0';
+    output.println(line);
+  }
+  noInterrupts();
+  const unsigned long lostCount = traceLostCount;
+  traceLostCount = 0;
+  interrupts();
+  output.print(F("END "));
+  output.println(lostCount);
+}
+
+// Adds an event to the trace and overwrites the oldest one if it is full.
+void Scheduler::traceRecord(const byte event, const byte arg, const unsigned long data) {
+  TraceRecord &record = traceBuffer[traceHead];
+  record.millis = traceMillis();
+  record.event = event;
+  record.arg = arg;
+  record.data = data > 0xFFFF ? 0xFFFF : data;
+  traceHead = traceHead + 1 == TRACE_BUFFER_SIZE ? 0 : traceHead + 1;
+  if (traceCount < TRACE_BUFFER_SIZE) {
+    traceCount++;
+  } else {
+    traceLostCount++;
   }
+}
 
+void Scheduler::traceTask(const byte event, Task *task) {
+  byte flags = traceFromInterrupt ? TRACE_FLAG_FROM_INTERRUPT : 0;
+  uintptr_t id;
+  if (task->isCallbackTask) {
+    id = (uintptr_t) ((CallbackTask*)task)->callback;
+  } else {
+    id = (uintptr_t) ((RunnableTask*)task)->runnable;
+    flags |= TRACE_FLAG_RUNNABLE;
+  }
+  traceRecord(event, flags, id & 0xFFFF);
+}
+#endif
+
+#ifdef TASK_POOL_SIZE
+unsigned int Scheduler::getTaskPoolOverflowCount() const {
+  noInterrupts();
+  const unsigned int count = taskPoolOverflowCount;
   interrupts();
+  return count;
 }
 
-void Scheduler::deleteTask(Task *taskToDelete, Task *previousTask) {
-  if (previousTask == NULL) {
-    // remove the first task
-    first = taskToDelete->next;
+void *Scheduler::Task::operator new(size_t) noexcept {
+  // may be called from an interrupt, so no heap is used
+#ifdef __AVR__
+  // restore the interrupt flag instead of enabling interrupts in the middle of an interrupt
+  const uint8_t sreg = SREG;
+  cli();
+#else
+  noInterrupts();
+#endif
+  TaskPoolEntry *entry = taskPoolFree;
+  if (entry != NULL) {
+    taskPoolFree = entry->nextFree;
   } else {
-    previousTask->next = taskToDelete->next;
+    taskPoolOverflowCount++;
+  }
+#ifdef __AVR__
+  SREG = sreg;
+#else
+  interrupts();
+#endif
+  return entry;
+}
+
+void Scheduler::Task::operator delete(void *task) noexcept {
+  if (task != NULL) {
+    TaskPoolEntry *entry = (TaskPoolEntry*) task;
+    entry->nextFree = taskPoolFree;
+    taskPoolFree = entry;
+#ifdef TASK_HANDLES
+    taskPoolGeneration[entry - taskPool]++;
+#endif
   }
-  delete taskToDelete;
+}
+#endif
+
+#ifdef TASK_HANDLES
+void Scheduler::scheduleDelayed(void (*callback)(), unsigned long delayMillis, TaskHandle &handle) {
+  Task *newTask = new CallbackTask(callback, getMillis() + delayMillis);
+  insertTaskWithHandle(newTask, handle);
+}
+
+void Scheduler::scheduleDelayed(Runnable *runnable, unsigned long delayMillis, TaskHandle &handle) {
+  Task *newTask = new RunnableTask(runnable, getMillis() + delayMillis);
+  insertTaskWithHandle(newTask, handle);
+}
+
+void Scheduler::scheduleAt(void (*callback)(), unsigned long uptimeMillis, TaskHandle &handle) {
+  Task *newTask = new CallbackTask(callback, uptimeMillis);
+  insertTaskWithHandle(newTask, handle);
+}
+
+void Scheduler::scheduleAt(Runnable *runnable, unsigned long uptimeMillis, TaskHandle &handle) {
+  Task *newTask = new RunnableTask(runnable, uptimeMillis);
+  insertTaskWithHandle(newTask, handle);
+}
+
+bool Scheduler::cancel(const TaskHandle &handle) {
+  bool cancelled = false;
+  noInterrupts();
+  Task *task = handleToTask(handle);
+  if (task != NULL && !isTaskStarted(task)) {
+    unlinkTask(task);
+#ifdef TASK_CALLBACK_INDEX_SIZE
+    indexRemove(task);
+#endif
+    delete task;
+    cancelled = true;
+  }
+  interrupts();
+  return cancelled;
+}
+
+bool Scheduler::rescheduleDelayed(const TaskHandle &handle, unsigned long delayMillis) {
+  const unsigned long uptimeMillis = getMillis() + delayMillis;
+  noInterrupts();
+  const bool rescheduled = rescheduleTask(handleToTask(handle), uptimeMillis);
+  interrupts();
+  return rescheduled;
 }
 
+bool Scheduler::rescheduleAt(const TaskHandle &handle, unsigned long uptimeMillis) {
+  noInterrupts();
+  const bool rescheduled = rescheduleTask(handleToTask(handle), uptimeMillis);
+  interrupts();
+  return rescheduled;
+}
+
+bool Scheduler::isScheduled(const TaskHandle &handle) const {
+  noInterrupts();
+  Task *task = handleToTask(handle);
+  const bool scheduled = task != NULL && !isTaskStarted(task);
+  interrupts();
+  return scheduled;
+}
+
+void Scheduler::insertTaskWithHandle(Task *newTask, TaskHandle &handle) {
+  handle.id = 0;
+  if (newTask == NULL) {
+    // task pool exhausted
+    return;
+  }
+  noInterrupts();
+  if (addTask(newTask, false)) {
+    const unsigned long index = (TaskPoolEntry*) newTask - taskPool;
+    handle.id = ((unsigned long) taskPoolGeneration[index] << 16) | (index + 1);
+  }
+  interrupts();
+}
+
+// Returns the task of the handle or NULL if it was deleted in the meantime.
+Scheduler::Task *Scheduler::handleToTask(const TaskHandle &handle) const {
+  const unsigned long index = (handle.id & 0xFFFF) - 1;
+  if (index >= TASK_POOL_SIZE || taskPoolGeneration[index] != handle.id >> 16) {
+    return NULL;
+  }
+  return (Task*) &taskPool[index];
+}
+
+// True if the task is running, it can not be changed with its handle then.
+bool Scheduler::isTaskStarted(Task *task) const {
+#ifdef ESP32_DUAL_CORE
+  return task == current || task == workerCurrent || task->handedOver;
+#else
+  return task == current;
+#endif
+}
+
+// Moves the task to the new time without deleting it, false if the task is NULL or running.
+bool Scheduler::rescheduleTask(Task *task, const unsigned long uptimeMillis) {
+  if (task == NULL || isTaskStarted(task)) {
+    return false;
+  }
+  unlinkTask(task);
+  task->scheduledUptimeMillis = uptimeMillis;
+#ifdef TASK_READY_LISTS
+  task->atFrontOfQueue = false;
+#endif
+  // there is space as the task was removed before
+  queueInsert(task);
+#ifdef TRACE_BUFFER_SIZE
+  traceTask(TRACE_SCHEDULE, task);
+#endif
+  return true;
+}
+#endif
+
 void Scheduler::setupTaskTimeoutIfConfigured() {
   noInterrupts();
-  if (taskTimeout != NO_SUPERVISION) {
-    taskWdtEnable(taskTimeout);
+  const TaskTimeout taskTimeoutLocal = taskTimeout;
+  interrupts();
+  // enabled without lock like in reactivateTaskTimeoutIfRequired(), the timer of ESP32 must not be set up in it
+  if (taskTimeoutLocal != NO_SUPERVISION) {
+    taskWdtEnable(taskTimeoutLocal);
 #ifdef SUPERVISION_CALLBACK
     wdtEnableInterrupt();
 #endif
   }
-  interrupts();
 }
 
 bool Scheduler::executeNextIfTime() {
+#ifdef SUBMISSION_RING_SIZE
+  submissionRingDrain();
+#endif
+  // read before the lock, getMillis() enables interrupts on AVR
+  const unsigned long currentMillis = getMillis();
   noInterrupts();
-  if (first != NULL && first->scheduledUptimeMillis <= getMillis()) {
-    current = first;
-    first = current->next;
+  current = removeFirstDueTask(currentMillis);
+#ifdef ESP32_DUAL_CORE
+  bool handedOver = false;
+  while (current != NULL && !runsOnMainCore(current)) {
+    workerQueueAppend(current);
+    handedOver = true;
+    current = removeFirstDueTask(currentMillis);
+  }
+#endif
+#ifdef TASK_CALLBACK_INDEX_SIZE
+  if (current != NULL) {
+    indexRemove(current);
+  }
+#endif
+#ifdef ESP32_DUAL_CORE
+  if (current == NULL) {
+    // nothing to do on this core, take a task that can run on both from the second core
+    current = workerQueueStealAny();
+  }
+#endif
+#ifdef TRACE_BUFFER_SIZE
+  if (current != NULL) {
+    traceTask(TRACE_TASK_START, current);
   }
+#endif
   interrupts();
+#ifdef ESP32_DUAL_CORE
+  if (handedOver) {
+    xTaskNotifyGive(workerTaskHandle);
+  }
+#endif
 
   if (current != NULL) {
-    taskWdtReset();
-    current->execute();
-    taskWdtReset();
-#ifdef SLEEP_DELAY
-    // use millis() instead of getMillis() because getMillis() may be manipulated by our WTD interrupt.
-    lastTaskFinishedMillis = millis();
-#endif
-    delete current;
-    noInterrupts();
-    current = NULL;
-    interrupts();
+    runTask(current);
     return true;
   } else {
     return false;
   }
 }
 
+// Removes the next task that is due from the run queue or NULL if none.
+// Called with interrupts disabled.
+Scheduler::Task *Scheduler::removeFirstDueTask(const unsigned long currentMillis) {
+#ifdef TASK_READY_LISTS
+  readyMoveDue(currentMillis);
+  return readyRemoveFirst();
+#else
+  return queueRemoveFirstIfDue(currentMillis);
+#endif
+}
+
+// Runs the task and then deletes or reschedules it. running is the variable of the
+// running task, current or the one of the second core, and is set to NULL afterwards.
+void Scheduler::runTask(Task *&running) {
+#ifdef TASK_STATS_SIZE
+  const unsigned long startMillis = getMillis();
+  const unsigned long startMicros = micros();
+#endif
+  taskWdtReset();
+  running->execute();
+  taskWdtReset();
+#ifdef TASK_DEADLINES
+  // tasks with a TaskCore have no deadline, so this is only done on the main core
+  if (running->deadlineMillis != 0) {
+    checkDeadline(running);
+  }
+#endif
+#ifdef TASK_STATS_SIZE
+  const unsigned long runMicros = timeDifference(micros(), startMicros);
+  unsigned long latenessMillis = 0;
+  if (timeBefore(running->scheduledUptimeMillis, startMillis)) {
+    latenessMillis = timeDifference(startMillis, running->scheduledUptimeMillis);
+  }
+  recordTaskStats(running, runMicros, latenessMillis);
+#endif
+#ifdef SLEEP_DELAY
+  // use millis() instead of getMillis() because getMillis() may be manipulated by our WTD interrupt.
+  const unsigned long finishedMillis = millis();
+#endif
+#ifdef PERIODIC_TASKS
+  const unsigned long currentMillis = getMillis();
+#endif
+  noInterrupts();
+#ifdef SLEEP_DELAY
+  // set in the lock, the second core of ESP32 also finishes tasks
+  lastTaskFinishedMillis = finishedMillis;
+#endif
+#ifdef TRACE_BUFFER_SIZE
+  traceTask(TRACE_TASK_END, running);
+#endif
+#ifdef PERIODIC_TASKS
+  if (running->periodMillis != 0) {
+    // reuse the task for the next run
+    reschedulePeriodicTask(running, currentMillis);
+  } else
+#endif
+  {
+    delete running;
+  }
+  running = NULL;
+  interrupts();
+}
+
 void Scheduler::reactivateTaskTimeoutIfRequired() {
   if (!isWakeupByOtherInterrupt()) {
     // woken up due to WDT interrupt in case of AVR
@@ -681,6 +2556,9 @@ void Scheduler::reactivateTaskTimeoutIfRequired() {
 }
 
 void Scheduler::execute() {
+#ifdef ESP32_DUAL_CORE
+  workerStart();
+#endif
   setupTaskTimeoutIfConfigured();
   while (true) {
     bool hasExecuted = executeNextIfTime();
@@ -690,16 +2568,44 @@ void Scheduler::execute() {
 
     sleepIfRequired();
     reactivateTaskTimeoutIfRequired();
+    // detects when getMillis() wraps
+    getMillis64();
   }
   // never executed so no need to deactivate the WDT
 }
 
 #endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
 
-#if defined(ESP32) || defined(ESP8266)
+#if !defined(ARDUINO)
+#include "DeepSleepScheduler_host_implementation.h"
+#elif defined(ESP32) || defined(ESP8266)
 #include "DeepSleepScheduler_esp_implementation.h"
+#elif defined(AVR_TIMER2_SLEEP)
+#include "DeepSleepScheduler_avr_timer2_implementation.h"
 #else
 #include "DeepSleepScheduler_avr_implementation.h"
 #endif
 
+#ifdef TASK_QUEUE_HEAP
+#include "DeepSleepScheduler_heap_implementation.h"
+#elif defined(TASK_QUEUE_TIMING_WHEEL)
+#include "DeepSleepScheduler_wheel_implementation.h"
+#else
+#include "DeepSleepScheduler_list_implementation.h"
+#endif
+#ifdef TASK_CALLBACK_INDEX_SIZE
+#include "DeepSleepScheduler_index_implementation.h"
+#endif
+#ifdef SUBMISSION_RING_SIZE
+#include "DeepSleepScheduler_ring_implementation.h"
+#endif
+#ifdef TASK_READY_LISTS
+#include "DeepSleepScheduler_ready_implementation.h"
+#endif
+
+#ifdef ESP32_DUAL_CORE
+#pragma pop_macro("noInterrupts")
+#pragma pop_macro("interrupts")
+#endif
+
 #endif // #ifndef DEEP_SLEEP_SCHEDULER_H
@@ -16,6 +16,20 @@
 #define MIN_WAIT_TIME_FOR_SLEEP SLEEP_TIME_1S
 #endif
 
+#ifdef WDT_CALIBRATION
+#ifndef WDT_CALIBRATION_WEIGHT
+#define WDT_CALIBRATION_WEIGHT 8
+#endif
+#ifndef WDT_CALIBRATION_SAVE_INTERVAL_MILLIS
+// 6 hours
+#define WDT_CALIBRATION_SAVE_INTERVAL_MILLIS 21600000UL
+#endif
+#ifndef WDT_CALIBRATION_SAVE_DEVIATION
+// 1 / 200 = 0.5 %
+#define WDT_CALIBRATION_SAVE_DEVIATION 200
+#endif
+#endif
+
 #ifndef SLEEP_TIME_15MS_CORRECTION
 #define SLEEP_TIME_15MS_CORRECTION 3
 #endif
@@ -49,16 +63,20 @@
 
 // Constants
 // =========
-#define SLEEP_TIME_15MS 15 + SLEEP_TIME_15MS_CORRECTION
-#define SLEEP_TIME_30MS 30 + SLEEP_TIME_30MS_CORRECTION
-#define SLEEP_TIME_60MS 60 + SLEEP_TIME_60MS_CORRECTION
-#define SLEEP_TIME_120MS 120 + SLEEP_TIME_120MS_CORRECTION
-#define SLEEP_TIME_250MS 250 + SLEEP_TIME_250MS_CORRECTION
-#define SLEEP_TIME_500MS 500 + SLEEP_TIME_500MS_CORRECTION
-#define SLEEP_TIME_1S 1000 + SLEEP_TIME_1S_CORRECTION
-#define SLEEP_TIME_2S 2000 + SLEEP_TIME_2S_CORRECTION
-#define SLEEP_TIME_4S 4000 + SLEEP_TIME_4S_CORRECTION
-#define SLEEP_TIME_8S 8000 + SLEEP_TIME_8S_CORRECTION
+#define SLEEP_TIME_15MS (15 + SLEEP_TIME_15MS_CORRECTION)
+#define SLEEP_TIME_30MS (30 + SLEEP_TIME_30MS_CORRECTION)
+#define SLEEP_TIME_60MS (60 + SLEEP_TIME_60MS_CORRECTION)
+#define SLEEP_TIME_120MS (120 + SLEEP_TIME_120MS_CORRECTION)
+#define SLEEP_TIME_250MS (250 + SLEEP_TIME_250MS_CORRECTION)
+#define SLEEP_TIME_500MS (500 + SLEEP_TIME_500MS_CORRECTION)
+#define SLEEP_TIME_1S (1000 + SLEEP_TIME_1S_CORRECTION)
+#define SLEEP_TIME_2S (2000 + SLEEP_TIME_2S_CORRECTION)
+#define SLEEP_TIME_4S (4000 + SLEEP_TIME_4S_CORRECTION)
+#define SLEEP_TIME_8S (8000 + SLEEP_TIME_8S_CORRECTION)
+// number of WDT periods from 8S down to 15MS
+#define WDT_PERIOD_COUNT 10
+// marks valid calibration values in the EEPROM
+#define WDT_CALIBRATION_EEPROM_MAGIC 0xD5
 
 private:
 void init();
@@ -72,6 +90,52 @@ private:
 static volatile unsigned int wdtSleepTimeMillis;
 static volatile unsigned long millisInDeepSleep;
 static volatile unsigned long millisBeforeDeepSleep;
+/**
+   The planned chain of WDT periods that follow the currently running one.
+   wdtPlanLongPeriods counts the remaining 8S periods, bit i of wdtPlanPeriodMask
+   is set when the period with index i in wdtPeriodMillis is still to run.
+*/
+static volatile unsigned long wdtPlanLongPeriods;
+static volatile unsigned int wdtPlanPeriodMask;
+/**
+   Set by the WDT interrupt when it armed the next planned period so that
+   the CPU goes to sleep again without returning to the scheduler loop.
+*/
+static volatile bool wdtSleepContinued;
+#ifdef SLEEP_STATS
+/**
+   Set by the WDT interrupt when it ended a sleep period, used to count the wakeups.
+*/
+static volatile bool wdtSleepWakeup;
+#endif
+/**
+   State of wdtPlanSearch(), the durations of the periods and the best plan found so far.
+*/
+struct WdtPlanSearch {
+  unsigned int periodMillis[WDT_PERIOD_COUNT];
+  unsigned int sumMillis[WDT_PERIOD_COUNT + 1];
+  unsigned int bestRemainingMillis;
+  unsigned int bestMask;
+  byte bestCount;
+};
+static const uint8_t wdtPeriodPrescalers[WDT_PERIOD_COUNT] PROGMEM;
+static const unsigned int wdtPeriodMillis[WDT_PERIOD_COUNT] PROGMEM;
+#ifdef WDT_CALIBRATION
+/**
+   Running estimate of the duration of each WDT period measured against micros()
+   while the CPU is idle. 0 if the period was not measured yet.
+*/
+static unsigned long wdtCalibratedMicros[WDT_PERIOD_COUNT];
+static volatile bool wdtCalibrationRunning;
+static volatile unsigned long wdtCalibrationEndMicros;
+byte wdtCalibrationNextIndex;
+#ifdef WDT_CALIBRATION_EEPROM_ADDRESS
+/**
+   getMillis() when the calibration was last compared against the EEPROM.
+*/
+unsigned long wdtCalibrationSaveMillis;
+#endif
+#endif
 /**
    Stores the time of the task from which the sleep time of the WDT is
    calculated when it is put to sleep.
@@ -85,7 +149,24 @@ inline void taskWdtDisable();
 inline void sleepIfRequired();
 bool isWakeupByOtherInterrupt();
 
-void wdtEnableInterrupt();
+static void wdtEnableInterrupt();
 inline SleepMode evaluateSleepModeAndEnableWdtIfRequired();
 inline unsigned long wdtEnableForSleep(unsigned long maxWaitTimeMillis);
+static inline void wdtPlanSleep(unsigned long maxWaitTimeMillis);
+static void wdtPlanSearch(WdtPlanSearch &search, const byte index, const unsigned int remainingMillis,
+                          const unsigned int mask, const byte count);
+static inline unsigned int wdtArmNextPlannedPeriod();
+static inline void wdtPlanCancel();
+inline bool continuePlannedSleep();
+#ifdef SLEEP_STATS
+inline void sleepStatsCountWdtWakeup();
+#endif
+static inline unsigned int wdtPeriodDuration(byte index);
+#ifdef WDT_CALIBRATION
+inline bool wdtCalibrateWhileIdle();
+inline void wdtCalibrationUpdate(byte index, unsigned long measuredMicros);
+#ifdef WDT_CALIBRATION_EEPROM_ADDRESS
+inline void wdtCalibrationSaveIfRequired();
+#endif
+#endif
 
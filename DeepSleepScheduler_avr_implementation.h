@@ -1,6 +1,9 @@
 
 #include <avr/sleep.h>
 #include <avr/wdt.h>
+#ifdef WDT_CALIBRATION_EEPROM_ADDRESS
+#include <EEPROM.h>
+#endif
 
 #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
 // -------------------------------------------------------------------------------------------------
@@ -10,12 +13,52 @@
 volatile unsigned int Scheduler::wdtSleepTimeMillis;
 volatile unsigned long Scheduler::millisInDeepSleep;
 volatile unsigned long Scheduler::millisBeforeDeepSleep;
+volatile unsigned long Scheduler::wdtPlanLongPeriods;
+volatile unsigned int Scheduler::wdtPlanPeriodMask;
+volatile bool Scheduler::wdtSleepContinued;
+#ifdef SLEEP_STATS
+volatile bool Scheduler::wdtSleepWakeup;
+#endif
+
+const uint8_t Scheduler::wdtPeriodPrescalers[WDT_PERIOD_COUNT] PROGMEM = {
+  WDTO_8S, WDTO_4S, WDTO_2S, WDTO_1S, WDTO_500MS,
+  WDTO_250MS, WDTO_120MS, WDTO_60MS, WDTO_30MS, WDTO_15MS
+};
+const unsigned int Scheduler::wdtPeriodMillis[WDT_PERIOD_COUNT] PROGMEM = {
+  SLEEP_TIME_8S, SLEEP_TIME_4S, SLEEP_TIME_2S, SLEEP_TIME_1S, SLEEP_TIME_500MS,
+  SLEEP_TIME_250MS, SLEEP_TIME_120MS, SLEEP_TIME_60MS, SLEEP_TIME_30MS, SLEEP_TIME_15MS
+};
+#ifdef WDT_CALIBRATION
+unsigned long Scheduler::wdtCalibratedMicros[WDT_PERIOD_COUNT];
+volatile bool Scheduler::wdtCalibrationRunning;
+volatile unsigned long Scheduler::wdtCalibrationEndMicros;
+#endif
 
 void Scheduler::init() {
   wdtSleepTimeMillis = 0;
   millisInDeepSleep = 0;
   millisBeforeDeepSleep = 0;
+  wdtPlanLongPeriods = 0;
+  wdtPlanPeriodMask = 0;
+  wdtSleepContinued = false;
+#ifdef SLEEP_STATS
+  wdtSleepWakeup = false;
+#endif
   firstRegularlyScheduledUptimeAfterSleep = 0;
+#ifdef WDT_CALIBRATION
+  wdtCalibrationRunning = false;
+  wdtCalibrationEndMicros = 0;
+  wdtCalibrationNextIndex = 0;
+  for (byte i = 0; i < WDT_PERIOD_COUNT; i++) {
+    wdtCalibratedMicros[i] = 0;
+  }
+#ifdef WDT_CALIBRATION_EEPROM_ADDRESS
+  wdtCalibrationSaveMillis = 0;
+  if (EEPROM.read(WDT_CALIBRATION_EEPROM_ADDRESS) == WDT_CALIBRATION_EEPROM_MAGIC) {
+    EEPROM.get(WDT_CALIBRATION_EEPROM_ADDRESS + 1, wdtCalibratedMicros);
+  }
+#endif
+#endif
 }
 
 unsigned long Scheduler::getMillis() const {
@@ -26,6 +69,12 @@ unsigned long Scheduler::getMillis() const {
   return value;
 }
 
+#ifdef TRACE_BUFFER_SIZE
+unsigned long Scheduler::traceMillis() {
+  return millis() + millisInDeepSleep;
+}
+#endif
+
 void Scheduler::taskWdtEnable(const uint8_t value) {
   wdt_enable(value);
 }
@@ -52,16 +101,26 @@ void Scheduler::sleepIfRequired() {
   // but continue execution immediatelly.
   sleep_enable(); // enables the sleep bit, a safety pin
   noInterrupts();
-  bool queueEmpty = first == NULL;
+  bool queueEmpty = queueIsEmpty();
+#ifdef SLEEP_STATS
+  // a WDT interrupt while the CPU was awake did not wake it up
+  wdtSleepWakeup = false;
+#endif
   interrupts();
   SleepMode sleepMode = IDLE;
+#ifdef SUBMISSION_RING_SIZE
+  if (!submissionRingIsEmpty()) {
+    // an interrupt scheduled a task that is not in the run queue yet
+    sleepMode = NO_SLEEP;
+  } else
+#endif
   if (!queueEmpty) {
     sleepMode = evaluateSleepModeAndEnableWdtIfRequired();
   } else {
     // nothing in the queue
     if (doesSleep()
 #ifdef SLEEP_DELAY
-        && millis() >= lastTaskFinishedMillis + SLEEP_DELAY
+        && millis() - lastTaskFinishedMillis >= SLEEP_DELAY
 #endif
        ) {
       taskWdtDisable();
@@ -83,12 +142,51 @@ void Scheduler::sleepIfRequired() {
       // turn off brown-out in software
 #if defined(BODS) && defined(BODSE)
       sleep_bod_disable();
+#endif
+#ifdef TRACE_BUFFER_SIZE
+      traceRecord(TRACE_SLEEP_ENTER, SLEEP_MODE, wdtSleepTimeMillis);
 #endif
       interrupts ();             // guarantees next instruction executed
       sleep_cpu(); // here the device is actually put to sleep
+#ifdef SLEEP_STATS
+      sleepStatsCountWdtWakeup();
+#endif
+      // The WDT interrupt arms the next period of a planned sleep itself,
+      // so we go back to sleep without returning to the scheduler loop.
+      while (continuePlannedSleep()) {
+#if defined(BODS) && defined(BODSE)
+        sleep_bod_disable();
+#endif
+#ifdef TRACE_BUFFER_SIZE
+        traceRecord(TRACE_SLEEP_ENTER, SLEEP_MODE, wdtSleepTimeMillis);
+#endif
+        interrupts ();             // guarantees next instruction executed
+        sleep_cpu();
+#ifdef SLEEP_STATS
+        sleepStatsCountWdtWakeup();
+#endif
+      }
+#ifdef TRACE_BUFFER_SIZE
+      noInterrupts();
+      // the WDT still runs if an other interrupt woke the CPU up
+      traceRecord(TRACE_SLEEP_EXIT, SLEEP_MODE, wdtSleepTimeMillis != 0);
+      interrupts();
+#endif
     } else { // IDLE
-      set_sleep_mode(SLEEP_MODE_IDLE);
-      sleep_cpu(); // here the device is actually put to sleep
+#ifdef SLEEP_STATS
+      // millis() as the sleep time is added by the WDT interrupt, possibly while in idle mode
+      const unsigned long idleStartMillis = millis();
+#endif
+#ifdef WDT_CALIBRATION
+      if (!wdtCalibrateWhileIdle())
+#endif
+      {
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_cpu(); // here the device is actually put to sleep
+      }
+#ifdef SLEEP_STATS
+      sleepStatsAddTime(IDLE, millis() - idleStartMillis);
+#endif
     }
     // THE PROGRAM CONTINUES FROM HERE AFTER WAKING UP
 #ifdef AWAKE_INDICATION_PIN
@@ -103,13 +201,14 @@ void Scheduler::sleepIfRequired() {
 }
 
 inline Scheduler::SleepMode Scheduler::evaluateSleepModeAndEnableWdtIfRequired() {
+  // read before the lock, getMillis() enables interrupts
+  unsigned long currentSchedulerMillis = getMillis();
   noInterrupts();
   unsigned long wdtSleepTimeMillisLocal = wdtSleepTimeMillis;
-  unsigned long currentSchedulerMillis = getMillis();
 
   unsigned long firstScheduledUptimeMillis = 0;
-  if (first != NULL) {
-    firstScheduledUptimeMillis = first->scheduledUptimeMillis;
+  if (!queueIsEmpty()) {
+    firstScheduledUptimeMillis = nextWakeupMillis();
   }
   interrupts();
 
@@ -118,7 +217,7 @@ inline Scheduler::SleepMode Scheduler::evaluateSleepModeAndEnableWdtIfRequired()
     // not woken up during WDT sleep
 
     unsigned long maxWaitTimeMillis = 0;
-    if (firstScheduledUptimeMillis > currentSchedulerMillis) {
+    if (timeBefore(currentSchedulerMillis, firstScheduledUptimeMillis)) {
       maxWaitTimeMillis = firstScheduledUptimeMillis - currentSchedulerMillis;
     }
 
@@ -126,7 +225,7 @@ inline Scheduler::SleepMode Scheduler::evaluateSleepModeAndEnableWdtIfRequired()
       sleepMode = NO_SLEEP;
     } else if (!doesSleep() || maxWaitTimeMillis < MIN_WAIT_TIME_FOR_SLEEP + BUFFER_TIME
 #ifdef SLEEP_DELAY
-               || millis() < lastTaskFinishedMillis + SLEEP_DELAY
+               || millis() - lastTaskFinishedMillis < SLEEP_DELAY
 #endif
               ) {
       // use SLEEP_MODE_IDLE for values less then MIN_WAIT_TIME_FOR_SLEEP
@@ -134,6 +233,11 @@ inline Scheduler::SleepMode Scheduler::evaluateSleepModeAndEnableWdtIfRequired()
     } else {
       sleepMode = SLEEP;
       firstRegularlyScheduledUptimeAfterSleep = firstScheduledUptimeMillis;
+#ifdef TIMER_SLACK
+      noInterrupts();
+      countSavedWakeups(firstScheduledUptimeMillis);
+      interrupts();
+#endif
 
       wdtSleepTimeMillisLocal = wdtEnableForSleep(maxWaitTimeMillis);
 
@@ -153,13 +257,13 @@ inline Scheduler::SleepMode Scheduler::evaluateSleepModeAndEnableWdtIfRequired()
     // If the WDT interrupt occurs before that, it is executed earlier as expected because getMillis() will be
     // corrected when the WTD occurs.
 
-    if (firstScheduledUptimeMillis < firstRegularlyScheduledUptimeAfterSleep) {
+    if (timeBefore(firstScheduledUptimeMillis, firstRegularlyScheduledUptimeAfterSleep)) {
       sleepMode = IDLE;
     } else {
 #ifdef SLEEP_DELAY
       // The CPU was woken up by an interrupt other than WDT.
       // The interrupt may have scheduled a task to run immediatelly. In that case we delay deep sleep.
-      if (millis() < lastTaskFinishedMillis + SLEEP_DELAY) {
+      if (millis() - lastTaskFinishedMillis < SLEEP_DELAY) {
         sleepMode = IDLE;
       } else {
         sleepMode = SLEEP;
@@ -170,52 +274,338 @@ inline Scheduler::SleepMode Scheduler::evaluateSleepModeAndEnableWdtIfRequired()
   return sleepMode;
 }
 
+/**
+  Plans the chain of WDT periods for maxWaitTimeMillis, arms the first one
+  and returns its duration.
+*/
 inline unsigned long Scheduler::wdtEnableForSleep(const unsigned long maxWaitTimeMillis) {
-  unsigned long wdtSleepTimeMillis;
-  if (maxWaitTimeMillis >= SLEEP_TIME_8S + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_8S;
-    wdt_enable(WDTO_8S);
-  } else if (maxWaitTimeMillis >= SLEEP_TIME_4S + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_4S;
-    wdt_enable(WDTO_4S);
-  } else if (maxWaitTimeMillis >= SLEEP_TIME_2S + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_2S;
-    wdt_enable(WDTO_2S);
-  } else if (maxWaitTimeMillis >= SLEEP_TIME_1S + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_1S;
-    wdt_enable(WDTO_1S);
-  } else if (maxWaitTimeMillis >= SLEEP_TIME_500MS + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_500MS;
-    wdt_enable(WDTO_500MS);
-  } else if (maxWaitTimeMillis >= SLEEP_TIME_250MS + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_250MS;
-    wdt_enable(WDTO_250MS);
-  } else if (maxWaitTimeMillis >= SLEEP_TIME_120MS + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_120MS;
-    wdt_enable(WDTO_120MS);
-  } else if (maxWaitTimeMillis >= SLEEP_TIME_60MS + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_60MS;
-    wdt_enable(WDTO_60MS);
-  } else if (maxWaitTimeMillis >= SLEEP_TIME_30MS + BUFFER_TIME) {
-    wdtSleepTimeMillis = SLEEP_TIME_30MS;
-    wdt_enable(WDTO_30MS);
-  } else { // maxWaitTimeMs >= 17
-    wdtSleepTimeMillis = SLEEP_TIME_15MS;
-    wdt_enable(WDTO_15MS);
-  }
+  noInterrupts();
+  wdtPlanSleep(maxWaitTimeMillis);
+  const unsigned int wdtSleepTimeMillis = wdtArmNextPlannedPeriod();
+  interrupts();
   return wdtSleepTimeMillis;
 }
 
+/**
+  Splits maxWaitTimeMillis into WDT periods so that the least time remains, with the fewest
+  periods if several plans leave the same time. Taking the largest period that fits first is
+  only best while every period is longer than all shorter ones together. The default
+  corrections keep that by a few milliseconds but calibrated durations may not, so the
+  periods are searched. All but the last 8S periods are taken up front and every other
+  period is used at most once. Like the sleep itself, a period is only added while at least
+  MIN_WAIT_TIME_FOR_SLEEP remains. What remains at the end is waited in SLEEP_MODE_IDLE
+  after the last wakeup.
+  Must be called with interrupts disabled.
+*/
+inline void Scheduler::wdtPlanSleep(unsigned long maxWaitTimeMillis) {
+  WdtPlanSearch search;
+  for (byte i = 0; i < WDT_PERIOD_COUNT; i++) {
+    search.periodMillis[i] = wdtPeriodDuration(i);
+  }
+  wdtPlanLongPeriods = 0;
+  if (maxWaitTimeMillis >= 2 * (unsigned long) search.periodMillis[0] + BUFFER_TIME) {
+    wdtPlanLongPeriods = (maxWaitTimeMillis - BUFFER_TIME) / search.periodMillis[0] - 1;
+    maxWaitTimeMillis -= wdtPlanLongPeriods * search.periodMillis[0];
+  }
+  // the time that all periods from index i on can fill at most
+  search.sumMillis[WDT_PERIOD_COUNT] = 0;
+  for (byte i = WDT_PERIOD_COUNT; i > 0; i--) {
+    search.sumMillis[i - 1] = search.sumMillis[i] + search.periodMillis[i - 1];
+  }
+  search.bestRemainingMillis = maxWaitTimeMillis;
+  search.bestMask = 0;
+  search.bestCount = 0;
+  wdtPlanSearch(search, 0, search.bestRemainingMillis, 0, 0);
+  wdtPlanPeriodMask = search.bestMask;
+  if (wdtPlanLongPeriods == 0 && wdtPlanPeriodMask == 0) {
+    // MIN_WAIT_TIME_FOR_SLEEP is below the shortest period, sleep at least that one
+    wdtPlanPeriodMask = 1 << (WDT_PERIOD_COUNT - 1);
+  }
+}
+
+/**
+  Adds the plans of the periods from index on to the ones with remainingMillis left and
+  keeps the best one in search. Branches that cannot leave less time are skipped.
+*/
+void Scheduler::wdtPlanSearch(WdtPlanSearch &search, const byte index, const unsigned int remainingMillis,
+                              const unsigned int mask, const byte count) {
+  if (remainingMillis < search.bestRemainingMillis
+      || (remainingMillis == search.bestRemainingMillis && count < search.bestCount)) {
+    search.bestRemainingMillis = remainingMillis;
+    search.bestMask = mask;
+    search.bestCount = count;
+  }
+  if (index == WDT_PERIOD_COUNT || remainingMillis < MIN_WAIT_TIME_FOR_SLEEP + BUFFER_TIME
+      || remainingMillis > search.bestRemainingMillis + search.sumMillis[index]) {
+    // no period may be added or even all of them leave more time
+    return;
+  }
+  const unsigned int periodMillis = search.periodMillis[index];
+  if (remainingMillis >= periodMillis + BUFFER_TIME) {
+    wdtPlanSearch(search, index + 1, remainingMillis - periodMillis, mask | 1 << index, count + 1);
+  }
+  wdtPlanSearch(search, index + 1, remainingMillis, mask, count);
+}
+
+/**
+  Arms the WDT with the next period of the plan and removes it from the plan.
+  Returns the duration of the armed period or 0 if the plan is empty.
+  Must be called with interrupts disabled.
+*/
+inline unsigned int Scheduler::wdtArmNextPlannedPeriod() {
+  byte i = 0;
+  if (wdtPlanLongPeriods > 0) {
+    wdtPlanLongPeriods--;
+  } else if (wdtPlanPeriodMask != 0) {
+    while ((wdtPlanPeriodMask & (1 << i)) == 0) {
+      i++;
+    }
+    wdtPlanPeriodMask &= ~(1 << i);
+  } else {
+    return 0;
+  }
+  wdt_enable(pgm_read_byte(&wdtPeriodPrescalers[i]));
+  return wdtPeriodDuration(i);
+}
+
+/**
+  Returns the time in milliseconds the CPU sleeps with the WDT period of the given index.
+  Without calibration or before the first measurement, it is the nominal time plus its
+  SLEEP_TIME_XXX_CORRECTION.
+*/
+inline unsigned int Scheduler::wdtPeriodDuration(const byte index) {
+  const unsigned int periodMillis = pgm_read_word(&wdtPeriodMillis[index]);
+#ifdef WDT_CALIBRATION
+  if (wdtCalibratedMicros[index] != 0) {
+    return (wdtCalibratedMicros[index] + 500) / 1000;
+  }
+  // Long periods rarely fit into an idle wait. All periods are derived from the same
+  // oscillator, so scale by the deviation of the longest measured shorter period.
+  for (byte i = index + 1; i < WDT_PERIOD_COUNT; i++) {
+    if (wdtCalibratedMicros[i] != 0) {
+      const unsigned long microsPerMillis = wdtCalibratedMicros[i] / pgm_read_word(&wdtPeriodMillis[i]);
+      return (periodMillis * microsPerMillis + 500) / 1000;
+    }
+  }
+#endif
+  return periodMillis;
+}
+
+/**
+  Must be called with interrupts disabled.
+*/
+inline void Scheduler::wdtPlanCancel() {
+  wdtPlanLongPeriods = 0;
+  wdtPlanPeriodMask = 0;
+  wdtSleepContinued = false;
+}
+
+#ifdef WDT_CALIBRATION
+/**
+  Measures a WDT period against micros() instead of idling for a single millisecond.
+  The period is chosen in turn but must fit into the time the CPU stays idle anyway.
+  Returns false if no period fits.
+*/
+inline bool Scheduler::wdtCalibrateWhileIdle() {
+  noInterrupts();
+  const bool wdtSleepRunning = wdtSleepTimeMillis != 0;
+  interrupts();
+  if (wdtSleepRunning) {
+    // woken up by an other interrupt during WDT sleep
+    return false;
+  }
+
+  unsigned long maxWaitTimeMillis = SLEEP_TIME_8S + BUFFER_TIME;
+  const unsigned long currentSchedulerMillis = getMillis();
+  noInterrupts();
+  if (!queueIsEmpty()) {
+    const unsigned long firstScheduledUptimeMillis = nextWakeupMillis();
+    if (!timeBefore(currentSchedulerMillis, firstScheduledUptimeMillis)) {
+      maxWaitTimeMillis = 0;
+    } else if (firstScheduledUptimeMillis - currentSchedulerMillis < maxWaitTimeMillis) {
+      maxWaitTimeMillis = firstScheduledUptimeMillis - currentSchedulerMillis;
+    }
+  }
+  interrupts();
+#ifdef SLEEP_DELAY
+  // do not delay deep sleep beyond SLEEP_DELAY
+  const unsigned long sinceLastTaskMillis = millis() - lastTaskFinishedMillis;
+  if (sinceLastTaskMillis < SLEEP_DELAY && SLEEP_DELAY - sinceLastTaskMillis < maxWaitTimeMillis) {
+    maxWaitTimeMillis = SLEEP_DELAY - sinceLastTaskMillis;
+  }
+#endif
+
+  byte index = wdtCalibrationNextIndex;
+  wdtCalibrationNextIndex = (index + 1) % WDT_PERIOD_COUNT;
+  while (index < WDT_PERIOD_COUNT && maxWaitTimeMillis < wdtPeriodDuration(index) + BUFFER_TIME) {
+    index++;
+  }
+  if (index == WDT_PERIOD_COUNT) {
+    return false;
+  }
+
+  noInterrupts();
+  wdtCalibrationRunning = true;
+  wdt_reset();
+  wdt_enable(pgm_read_byte(&wdtPeriodPrescalers[index]));
+  wdtEnableInterrupt();
+  const unsigned long startMicros = micros();
+  interrupts();
+
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  while (true) {
+    sleep_enable();
+    sleep_cpu(); // woken up by the millis timer or the WDT
+    const unsigned long currentMillis = getMillis();
+    noInterrupts();
+    if (!wdtCalibrationRunning) {
+      const unsigned long measuredMicros = wdtCalibrationEndMicros - startMicros;
+      wdtCalibrationUpdate(index, measuredMicros);
+      interrupts();
+      break;
+    }
+    bool cancel = !queueIsEmpty() && !timeBefore(currentMillis, nextWakeupMillis());
+#ifdef SUBMISSION_RING_SIZE
+    cancel = cancel || !submissionRingIsEmpty();
+#endif
+    if (cancel) {
+      // an interrupt scheduled a task that is due, the WDT is set back by the scheduler loop
+      wdtCalibrationRunning = false;
+      interrupts();
+      break;
+    }
+    interrupts();
+  }
+#ifdef WDT_CALIBRATION_EEPROM_ADDRESS
+  wdtCalibrationSaveIfRequired();
+#endif
+  return true;
+}
+
+#ifdef WDT_CALIBRATION_EEPROM_ADDRESS
+/**
+  Writes the estimates to the EEPROM at most once per WDT_CALIBRATION_SAVE_INTERVAL_MILLIS.
+  The estimate changes with almost every measurement, so only entries that deviate
+  more than 1 / WDT_CALIBRATION_SAVE_DEVIATION from the saved value are written
+  to not wear out the EEPROM.
+*/
+inline void Scheduler::wdtCalibrationSaveIfRequired() {
+  const unsigned long currentMillis = getMillis();
+  if (currentMillis - wdtCalibrationSaveMillis < WDT_CALIBRATION_SAVE_INTERVAL_MILLIS) {
+    return;
+  }
+  wdtCalibrationSaveMillis = currentMillis;
+  const bool valid = EEPROM.read(WDT_CALIBRATION_EEPROM_ADDRESS) == WDT_CALIBRATION_EEPROM_MAGIC;
+  for (byte i = 0; i < WDT_PERIOD_COUNT; i++) {
+    const int address = WDT_CALIBRATION_EEPROM_ADDRESS + 1 + i * sizeof(unsigned long);
+    unsigned long savedMicros = 0;
+    if (valid) {
+      EEPROM.get(address, savedMicros);
+    }
+    const unsigned long estimateMicros = wdtCalibratedMicros[i];
+    const unsigned long deviationMicros = estimateMicros > savedMicros
+                                          ? estimateMicros - savedMicros : savedMicros - estimateMicros;
+    if (!valid || deviationMicros > savedMicros / WDT_CALIBRATION_SAVE_DEVIATION) {
+      EEPROM.put(address, estimateMicros);
+    }
+  }
+  if (!valid) {
+    EEPROM.update(WDT_CALIBRATION_EEPROM_ADDRESS, WDT_CALIBRATION_EEPROM_MAGIC);
+  }
+}
+#endif
+
+/**
+  Must be called with interrupts disabled.
+*/
+inline void Scheduler::wdtCalibrationUpdate(const byte index, const unsigned long measuredMicros) {
+  const unsigned long nominalMicros = pgm_read_word(&wdtPeriodMillis[index]) * 1000UL;
+  if (measuredMicros < nominalMicros / 2 || measuredMicros > nominalMicros + nominalMicros / 2) {
+    // implausible, e.g. a long running interrupt
+    return;
+  }
+  unsigned long &estimateMicros = wdtCalibratedMicros[index];
+  if (estimateMicros == 0) {
+    estimateMicros = measuredMicros;
+  } else {
+    estimateMicros += ((long) (measuredMicros - estimateMicros)) / WDT_CALIBRATION_WEIGHT;
+  }
+}
+#endif
+
+/**
+  Called after the CPU woke up from SLEEP. Returns true with interrupts disabled and the
+  sleep bit set if the WDT interrupt armed the next planned period and nothing else
+  needs the CPU. Otherwise the rest of the plan is dropped and the scheduler loop
+  evaluates the sleep time again.
+*/
+inline bool Scheduler::continuePlannedSleep() {
+  noInterrupts();
+  bool continueSleep = wdtSleepContinued;
+  wdtSleepContinued = false;
+#ifdef SUBMISSION_RING_SIZE
+  if (!submissionRingIsEmpty()) {
+    continueSleep = false;
+  }
+#endif
+  if (continueSleep && !queueIsEmpty() && timeBefore(nextWakeupMillis(), firstRegularlyScheduledUptimeAfterSleep)) {
+    // an interrupt scheduled a task that is due earlier
+    continueSleep = false;
+  }
+  if (continueSleep) {
+    sleep_enable();
+  } else {
+    wdtPlanCancel();
+    interrupts();
+  }
+  return continueSleep;
+}
+
+#ifdef SLEEP_STATS
+inline void Scheduler::sleepStatsCountWdtWakeup() {
+  noInterrupts();
+  const bool byWdt = wdtSleepWakeup;
+  wdtSleepWakeup = false;
+  interrupts();
+  sleepStatsAddWakeup(byWdt);
+}
+#endif
+
 void Scheduler::isrWdt() {
   sleep_disable();
+#ifdef WDT_CALIBRATION
+  if (wdtCalibrationRunning) {
+    wdtCalibrationEndMicros = micros();
+    wdtCalibrationRunning = false;
+    return;
+  }
+#endif
   millisInDeepSleep += wdtSleepTimeMillis;
   millisInDeepSleep -= millis() - millisBeforeDeepSleep;
-#ifdef SUPERVISION_CALLBACK
   const unsigned int wdtSleepTimeMillisBefore = wdtSleepTimeMillis;
-#endif
   wdtSleepTimeMillis = 0;
+  if (wdtSleepTimeMillisBefore != 0) {
+#ifdef SLEEP_STATS
+    const unsigned long awakeMillis = millis() - millisBeforeDeepSleep;
+    if (awakeMillis < wdtSleepTimeMillisBefore) {
+      sleepStatsSleepMillis += wdtSleepTimeMillisBefore - awakeMillis;
+    }
+    wdtSleepWakeup = true;
+#endif
+    // fast path of a planned sleep: arm the next period right here
+    wdtSleepTimeMillis = wdtArmNextPlannedPeriod();
+    if (wdtSleepTimeMillis != 0) {
+      wdtEnableInterrupt();
+      millisBeforeDeepSleep = millis();
+      wdtSleepContinued = true;
+    }
+    return;
+  }
 #ifdef SUPERVISION_CALLBACK
   if (wdtSleepTimeMillisBefore == 0 && supervisionCallbackRunnable != NULL) {
+#ifdef TRACE_BUFFER_SIZE
+    traceRecord(TRACE_SUPERVISION_TIMEOUT, 0, 0);
+#endif
     wdt_reset();
     // give the callback some time but reset if it fails
     wdt_enable(SUPERVISION_CALLBACK_TIMEOUT);
@@ -0,0 +1,91 @@
+
+// -------------------------------------------------------------------------------------------------
+// Definition of AVR with Timer2 clocked asynchronously by a 32.768 kHz watch crystal,
+// included inside of class Scheduler
+// -------------------------------------------------------------------------------------------------
+
+#ifndef AS2
+#error "AVR_TIMER2_SLEEP requires a CPU with asynchronous Timer2"
+#endif
+
+// values changeable by the user
+#ifndef SLEEP_MODE
+#define SLEEP_MODE SLEEP_MODE_PWR_SAVE
+#endif
+
+#ifndef SUPERVISION_CALLBACK_TIMEOUT
+#define SUPERVISION_CALLBACK_TIMEOUT WDTO_1S
+#endif
+
+#ifndef MIN_WAIT_TIME_FOR_SLEEP
+#define MIN_WAIT_TIME_FOR_SLEEP 10
+#endif
+
+// Constants
+// =========
+// 32768 Hz / prescaler 128, one tick is 3.90625 ms and Timer2 overflows once per second
+#define TIMER2_TICKS_PER_SECOND 256
+// minimal number of ticks until the compare match so that it is not missed
+#define TIMER2_MIN_COMPARE_TICKS 2
+
+private:
+void init();
+public:
+/**
+  Do not call this method, it is used by the watchdog interrupt.
+*/
+static void isrWdt();
+/**
+  Do not call this method, it is used by the Timer2 overflow interrupt.
+*/
+static void isrTimer2Overflow();
+#ifdef SLEEP_STATS
+/**
+  Do not call this method, it is used by the Timer2 compare match interrupt.
+*/
+static void isrTimer2Compare();
+#endif
+private:
+// variables used in the interrupt
+static volatile unsigned long timer2Overflows;
+static volatile unsigned long millisInDeepSleep;
+static volatile unsigned long millisBeforeDeepSleep;
+/**
+   Timer2 ticks when the CPU went to sleep, only valid while timer2Sleeping is set.
+*/
+static volatile unsigned long sleepStartTicks;
+static volatile bool timer2Sleeping;
+/**
+   Fraction of a millisecond in 1/256 ms not yet added to millisInDeepSleep.
+*/
+static byte sleepMillisFraction;
+#ifdef SLEEP_STATS
+/**
+   Set by the Timer2 interrupts, used to count the wakeups.
+*/
+static volatile bool timer2SleepWakeup;
+#endif
+/**
+   Stores the time of the task from which the sleep time is calculated when it is put to sleep.
+   In case an interrupt schedules a new time, this time is compared against
+   it to check if the new time is before the CPU would wake up anyway.
+*/
+unsigned long firstRegularlyScheduledUptimeAfterSleep;
+/**
+   Timer2 ticks at which the CPU wakes up from the next sleep.
+*/
+unsigned long sleepUntilTicks;
+
+void taskWdtEnable(const uint8_t value);
+inline void taskWdtDisable();
+inline void sleepIfRequired();
+bool isWakeupByOtherInterrupt();
+
+static void wdtEnableInterrupt();
+inline SleepMode evaluateSleepMode();
+inline void timer2StartIfRequired();
+static inline unsigned long timer2Ticks();
+static inline unsigned long timer2TicksToMillis(unsigned long ticks);
+static inline void timer2WaitForUpdate();
+inline void sleepUntil(unsigned long ticks);
+
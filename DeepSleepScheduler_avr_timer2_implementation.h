@@ -0,0 +1,349 @@
+
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+#ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
+// -------------------------------------------------------------------------------------------------
+// Implementation (usuallly in CPP file)
+// -------------------------------------------------------------------------------------------------
+
+volatile unsigned long Scheduler::timer2Overflows;
+volatile unsigned long Scheduler::millisInDeepSleep;
+volatile unsigned long Scheduler::millisBeforeDeepSleep;
+volatile unsigned long Scheduler::sleepStartTicks;
+volatile bool Scheduler::timer2Sleeping;
+byte Scheduler::sleepMillisFraction;
+#ifdef SLEEP_STATS
+volatile bool Scheduler::timer2SleepWakeup;
+#endif
+
+void Scheduler::init() {
+  timer2Overflows = 0;
+  millisInDeepSleep = 0;
+  millisBeforeDeepSleep = 0;
+  sleepStartTicks = 0;
+  timer2Sleeping = false;
+  sleepMillisFraction = 0;
+#ifdef SLEEP_STATS
+  timer2SleepWakeup = false;
+#endif
+  firstRegularlyScheduledUptimeAfterSleep = 0;
+  sleepUntilTicks = 0;
+}
+
+unsigned long Scheduler::getMillis() const {
+  unsigned long value;
+  noInterrupts();
+  if (timer2Sleeping) {
+    // called by an interrupt during sleep, millis() does not run but Timer2 does
+    value = millisBeforeDeepSleep + millisInDeepSleep + timer2TicksToMillis(timer2Ticks() - sleepStartTicks);
+  } else {
+    value = millis() + millisInDeepSleep;
+  }
+  interrupts();
+  return value;
+}
+
+#ifdef TRACE_BUFFER_SIZE
+unsigned long Scheduler::traceMillis() {
+  if (timer2Sleeping) {
+    return millisBeforeDeepSleep + millisInDeepSleep + timer2TicksToMillis(timer2Ticks() - sleepStartTicks);
+  }
+  return millis() + millisInDeepSleep;
+}
+#endif
+
+void Scheduler::taskWdtEnable(const uint8_t value) {
+  wdt_enable(value);
+}
+
+void Scheduler::taskWdtDisable() {
+  wdt_disable();
+}
+
+void Scheduler::taskWdtReset() {
+  wdt_reset();
+}
+
+bool Scheduler::isWakeupByOtherInterrupt() {
+  // the CPU only continues after the sleep time is over
+  // or a task was scheduled, the WDT can always be set back
+  return false;
+}
+
+void Scheduler::sleepIfRequired() {
+  timer2StartIfRequired();
+  noInterrupts();
+  bool queueEmpty = queueIsEmpty();
+  interrupts();
+  SleepMode sleepMode = IDLE;
+#ifdef SUBMISSION_RING_SIZE
+  if (!submissionRingIsEmpty()) {
+    // an interrupt scheduled a task that is not in the run queue yet
+    sleepMode = NO_SLEEP;
+  } else
+#endif
+  if (!queueEmpty) {
+    sleepMode = evaluateSleepMode();
+  } else {
+    // nothing in the queue
+    if (doesSleep()
+#ifdef SLEEP_DELAY
+        && millis() - lastTaskFinishedMillis >= SLEEP_DELAY
+#endif
+       ) {
+      sleepMode = SLEEP;
+      // sleep until a task is scheduled, Timer2 still wakes the CPU up once per second
+      firstRegularlyScheduledUptimeAfterSleep = getMillis() + 0x7FFFFFFF;
+      noInterrupts();
+      sleepUntilTicks = timer2Ticks() + 0x7FFFFFFF;
+      interrupts();
+    } else {
+      sleepMode = IDLE;
+    }
+  }
+  if (sleepMode != NO_SLEEP) {
+#ifdef SLEEP_STATS
+    const unsigned long sleepStartMillis = getMillis();
+#endif
+#ifdef AWAKE_INDICATION_PIN
+    digitalWrite(AWAKE_INDICATION_PIN, LOW);
+#endif
+    if (sleepMode == SLEEP) {
+      // the task WDT is set back by reactivateTaskTimeoutIfRequired()
+      taskWdtDisable();
+      set_sleep_mode(SLEEP_MODE);
+      const byte adcsraSave = ADCSRA;
+      ADCSRA = 0;  // disable ADC
+      sleepUntil(sleepUntilTicks);
+      // re-enable ADC
+      ADCSRA = adcsraSave;
+    } else { // IDLE
+      sleep_enable();
+      set_sleep_mode(SLEEP_MODE_IDLE);
+      sleep_cpu(); // here the device is actually put to sleep
+      sleep_disable();
+    }
+    // THE PROGRAM CONTINUES FROM HERE AFTER WAKING UP
+#ifdef AWAKE_INDICATION_PIN
+    digitalWrite(AWAKE_INDICATION_PIN, HIGH);
+#endif
+#ifdef SLEEP_STATS
+    sleepStatsAddTime(sleepMode, getMillis() - sleepStartMillis);
+#endif
+  }
+}
+
+inline Scheduler::SleepMode Scheduler::evaluateSleepMode() {
+  const unsigned long currentSchedulerMillis = getMillis();
+  noInterrupts();
+  unsigned long firstScheduledUptimeMillis = 0;
+  if (!queueIsEmpty()) {
+    firstScheduledUptimeMillis = nextWakeupMillis();
+  }
+  interrupts();
+
+  unsigned long maxWaitTimeMillis = 0;
+  if (timeBefore(currentSchedulerMillis, firstScheduledUptimeMillis)) {
+    maxWaitTimeMillis = firstScheduledUptimeMillis - currentSchedulerMillis;
+  }
+  // Wake up at the last tick before the task is due, the rest is waited in SLEEP_MODE_IDLE.
+  const unsigned long sleepTicks = maxWaitTimeMillis / 1000 * TIMER2_TICKS_PER_SECOND
+                                   + maxWaitTimeMillis % 1000 * TIMER2_TICKS_PER_SECOND / 1000;
+
+  SleepMode sleepMode = NO_SLEEP;
+  if (maxWaitTimeMillis == 0) {
+    sleepMode = NO_SLEEP;
+  } else if (!doesSleep() || maxWaitTimeMillis < MIN_WAIT_TIME_FOR_SLEEP || sleepTicks < TIMER2_MIN_COMPARE_TICKS
+#ifdef SLEEP_DELAY
+             || millis() - lastTaskFinishedMillis < SLEEP_DELAY
+#endif
+            ) {
+    sleepMode = IDLE;
+  } else {
+    sleepMode = SLEEP;
+    firstRegularlyScheduledUptimeAfterSleep = firstScheduledUptimeMillis;
+#ifdef TIMER_SLACK
+    noInterrupts();
+    countSavedWakeups(firstScheduledUptimeMillis);
+    interrupts();
+#endif
+    noInterrupts();
+    sleepUntilTicks = timer2Ticks() + sleepTicks;
+    interrupts();
+  }
+  return sleepMode;
+}
+
+/**
+  Puts the CPU to sleep until Timer2 reaches the given ticks. Wakeups by the Timer2 overflow
+  and by other interrupts go back to sleep directly unless the sleep is no longer allowed
+  or an interrupt scheduled a task that is due earlier.
+*/
+inline void Scheduler::sleepUntil(const unsigned long ticks) {
+  noInterrupts();
+  millisBeforeDeepSleep = millis();
+  sleepStartTicks = timer2Ticks();
+  timer2Sleeping = true;
+#ifdef TRACE_BUFFER_SIZE
+  traceRecord(TRACE_SLEEP_ENTER, SLEEP_MODE, timer2TicksToMillis(ticks - sleepStartTicks));
+#endif
+  interrupts();
+  while (true) {
+    noInterrupts();
+    // After waking up, TCNT2 is only valid after a register update. It also ensures that
+    // the new compare value is active before the CPU sleeps.
+    OCR2A = (byte) ticks;
+    timer2WaitForUpdate();
+    const long remainingTicks = ticks - timer2Ticks();
+    bool wakeUp = remainingTicks < TIMER2_MIN_COMPARE_TICKS || !doesSleep();
+#ifdef SUBMISSION_RING_SIZE
+    wakeUp = wakeUp || !submissionRingIsEmpty();
+#endif
+    if (!wakeUp && !queueIsEmpty() && timeBefore(nextWakeupMillis(), firstRegularlyScheduledUptimeAfterSleep)) {
+      // an interrupt scheduled a task that is due earlier
+      wakeUp = true;
+    }
+    if (wakeUp) {
+      break;
+    }
+    if (remainingTicks < TIMER2_TICKS_PER_SECOND) {
+      // the compare match is within the next 256 ticks
+      TIMSK2 |= (1 << OCIE2A);
+    } else {
+      TIMSK2 &= ~(1 << OCIE2A);
+    }
+#ifdef SLEEP_STATS
+    timer2SleepWakeup = false;
+#endif
+    sleep_enable();
+    // turn off brown-out in software
+#if defined(BODS) && defined(BODSE)
+    sleep_bod_disable();
+#endif
+    interrupts ();             // guarantees next instruction executed
+    sleep_cpu(); // here the device is actually put to sleep
+    sleep_disable();
+#ifdef SLEEP_STATS
+    sleepStatsAddWakeup(timer2SleepWakeup);
+#endif
+  }
+  // interrupts are still disabled
+  TIMSK2 &= ~(1 << OCIE2A);
+  const unsigned long sleptTicks = timer2Ticks() - sleepStartTicks;
+  const unsigned long fraction = (sleptTicks % TIMER2_TICKS_PER_SECOND) * 1000 + sleepMillisFraction;
+  millisInDeepSleep += sleptTicks / TIMER2_TICKS_PER_SECOND * 1000 + fraction / TIMER2_TICKS_PER_SECOND;
+  sleepMillisFraction = fraction % TIMER2_TICKS_PER_SECOND;
+  millisInDeepSleep -= millis() - millisBeforeDeepSleep;
+  timer2Sleeping = false;
+#ifdef TRACE_BUFFER_SIZE
+  // the sleep time is not over yet if it was ended by an other interrupt
+  traceRecord(TRACE_SLEEP_EXIT, SLEEP_MODE, (long) (ticks - timer2Ticks()) >= TIMER2_MIN_COMPARE_TICKS);
+#endif
+  interrupts();
+}
+
+/**
+  Switches Timer2 to the external 32.768 kHz crystal on the first call.
+  Done here and not in init() because the Arduino core configures Timer2 for PWM
+  after the constructor of the scheduler ran.
+*/
+inline void Scheduler::timer2StartIfRequired() {
+  if (ASSR & (1 << AS2)) {
+    return;
+  }
+  noInterrupts();
+  TIMSK2 = 0;
+  ASSR = (1 << AS2);
+  TCNT2 = 0;
+  TCCR2A = 0; // normal mode
+  TCCR2B = (1 << CS22) | (1 << CS20); // prescaler 128
+  interrupts();
+  // the crystal may take some time to start up
+  timer2WaitForUpdate();
+  noInterrupts();
+  TIFR2 = (1 << OCF2B) | (1 << OCF2A) | (1 << TOV2);
+  TIMSK2 = (1 << TOIE2);
+  interrupts();
+}
+
+/**
+  Must be called with interrupts disabled.
+*/
+inline unsigned long Scheduler::timer2Ticks() {
+  unsigned long overflows = timer2Overflows;
+  const byte counter = TCNT2;
+  if ((TIFR2 & (1 << TOV2)) && counter < 255) {
+    // the overflow interrupt did not run yet
+    overflows++;
+  }
+  return (overflows << 8) | counter;
+}
+
+inline unsigned long Scheduler::timer2TicksToMillis(const unsigned long ticks) {
+  return ticks / TIMER2_TICKS_PER_SECOND * 1000 + ticks % TIMER2_TICKS_PER_SECOND * 1000 / TIMER2_TICKS_PER_SECOND;
+}
+
+/**
+  Waits until writes to the asynchronous Timer2 registers are done.
+*/
+inline void Scheduler::timer2WaitForUpdate() {
+  while (ASSR & ((1 << TCN2UB) | (1 << OCR2AUB) | (1 << OCR2BUB) | (1 << TCR2AUB) | (1 << TCR2BUB)));
+}
+
+void Scheduler::isrTimer2Overflow() {
+  timer2Overflows++;
+#ifdef SLEEP_STATS
+  timer2SleepWakeup = true;
+#endif
+}
+
+#ifdef SLEEP_STATS
+void Scheduler::isrTimer2Compare() {
+  timer2SleepWakeup = true;
+}
+#endif
+
+void Scheduler::isrWdt() {
+#ifdef SUPERVISION_CALLBACK
+  // the WDT is only used for task supervision
+  if (supervisionCallbackRunnable != NULL) {
+#ifdef TRACE_BUFFER_SIZE
+    traceRecord(TRACE_SUPERVISION_TIMEOUT, 0, 0);
+#endif
+    wdt_reset();
+    // give the callback some time but reset if it fails
+    wdt_enable(SUPERVISION_CALLBACK_TIMEOUT);
+    supervisionCallbackRunnable->run();
+    // trigger restart
+    wdt_enable(WDTO_15MS);
+    while (1);
+  }
+#endif
+}
+
+/**
+  first timeout will be the interrupt, second system reset
+*/
+void Scheduler::wdtEnableInterrupt() {
+  // http://forum.arduino.cc/index.php?topic=108870.0
+  WDTCSR |= (1 << WDCE) | (1 << WDIE);
+}
+
+ISR (WDT_vect) {
+  // WDIE & WDIF is cleared in hardware upon entering this ISR
+  Scheduler::isrWdt();
+}
+
+ISR (TIMER2_OVF_vect) {
+  Scheduler::isrTimer2Overflow();
+}
+
+ISR (TIMER2_COMPA_vect) {
+  // only wakes the CPU up
+#ifdef SLEEP_STATS
+  Scheduler::isrTimer2Compare();
+#endif
+}
+
+#endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
@@ -8,6 +8,9 @@
 #ifndef ESP8266_MAX_DELAY_TIME_MS
 #define ESP8266_MAX_DELAY_TIME_MS 7000
 #endif
+#ifndef ESP32_DUAL_CORE_STACK_SIZE
+#define ESP32_DUAL_CORE_STACK_SIZE 4096
+#endif
 
 private:
 void init();
@@ -22,6 +25,41 @@ public:
 static void IRAM_ATTR isrWatchdogExpiredStatic();
 private:
 hw_timer_t *timer = NULL;
+#ifdef ESP32_DUAL_CORE
+/**
+   Locks the run queue instead of noInterrupts(), see ESP32_DUAL_CORE.
+*/
+static portMUX_TYPE taskMux;
+/**
+   the core that calls execute(), the second core runs the worker task
+*/
+static byte mainCore;
+TaskHandle_t workerTaskHandle;
+/**
+   Due tasks handed over to the second core, linked by next. Tasks with TASK_CORE_ANY
+   are taken back by the main core when it has nothing to do.
+*/
+Task *workerFirst;
+Task *workerLast;
+/**
+   the task currently running on the second core or null if none running
+*/
+Task *workerCurrent;
+
+void insertTaskWithCore(Task *newTask, const TaskCore core);
+void workerStart();
+static void workerLoop(void *parameter);
+inline bool workerExecuteNext();
+// These methods are called with interrupts disabled
+inline bool runsOnMainCore(Task *task) const;
+inline bool workerIsIdle() const;
+inline void workerQueueAppend(Task *task);
+inline Task *workerQueueRemoveFirst();
+inline Task *workerQueueStealAny();
+#ifdef PERIODIC_TASKS
+inline void workerStopPeriodic(Task *task);
+#endif
+#endif
 #elif ESP8266
 public:
 #endif
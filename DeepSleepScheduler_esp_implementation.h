@@ -12,7 +12,23 @@
 // Implementation (usuallly in CPP file)
 // -------------------------------------------------------------------------------------------------
 #define ESP8266_MAX_DELAY_TIME_WDT_MS 7500
+#if defined(ESP32) && defined(ESP32_DUAL_CORE)
+portMUX_TYPE Scheduler::taskMux = portMUX_INITIALIZER_UNLOCKED;
+#ifdef ARDUINO_RUNNING_CORE
+byte Scheduler::mainCore = ARDUINO_RUNNING_CORE;
+#else
+byte Scheduler::mainCore = 1;
+#endif
+
+void Scheduler::init() {
+  workerTaskHandle = NULL;
+  workerFirst = NULL;
+  workerLast = NULL;
+  workerCurrent = NULL;
+}
+#else
 void Scheduler::init() {}
+#endif
 
 #ifdef ESP32
 // -------------------------------------------------------------------------------------------------
@@ -24,7 +40,16 @@ unsigned long Scheduler::getMillis() const {
   return rtcTimeUs / 1000;
 }
 
+#ifdef TRACE_BUFFER_SIZE
+unsigned long Scheduler::traceMillis() {
+  return scheduler.getMillis();
+}
+#endif
+
 void IRAM_ATTR Scheduler::isrWatchdogExpiredStatic() {
+#ifdef TRACE_BUFFER_SIZE
+  traceRecord(TRACE_SUPERVISION_TIMEOUT, 0, 0);
+#endif
 #ifdef SUPERVISION_CALLBACK
   if (supervisionCallbackRunnable != NULL) {
     // No need to supervise this call as this interrupt has a time limit.
@@ -74,6 +99,12 @@ void Scheduler::taskWdtDisable() {
 }
 
 void Scheduler::taskWdtReset() {
+#ifdef ESP32_DUAL_CORE
+  if (xPortGetCoreID() != mainCore) {
+    // tasks on the second core are not supervised
+    return;
+  }
+#endif
   //reset timer (feed watchdog)
   if (timer != NULL) {
     timerWrite(timer, 0);
@@ -87,6 +118,12 @@ unsigned long Scheduler::getMillis() const {
   return millis();
 }
 
+#ifdef TRACE_BUFFER_SIZE
+unsigned long Scheduler::traceMillis() {
+  return millis();
+}
+#endif
+
 void Scheduler::taskWdtEnable(const uint8_t value) {
   const unsigned long durationMs = wdtTimeoutToDurationMs(value);
   ESP.wdtEnable(durationMs);
@@ -155,16 +192,29 @@ inline unsigned long Scheduler::wdtTimeoutToDurationMs(const uint8_t value) {
 
 void Scheduler::sleepIfRequired() {
   noInterrupts();
-  bool queueEmpty = first == NULL;
+  bool queueEmpty = queueIsEmpty();
+#ifdef SLEEP_DELAY
+  // read in the lock, the second core of ESP32 also sets it
+  const unsigned long lastTaskFinishedMillisLocal = lastTaskFinishedMillis;
+#endif
+#ifdef ESP32_DUAL_CORE
+  const bool workerIdle = workerIsIdle();
+#endif
   interrupts();
   SleepMode sleepMode = IDLE;
+#ifdef SUBMISSION_RING_SIZE
+  if (!submissionRingIsEmpty()) {
+    // an interrupt scheduled a task that is not in the run queue yet
+    sleepMode = NO_SLEEP;
+  } else
+#endif
   if (!queueEmpty) {
     sleepMode = evaluateSleepMode();
   } else {
     // nothing in the queue
     if (doesSleep()
 #ifdef SLEEP_DELAY
-        && millis() >= lastTaskFinishedMillis + SLEEP_DELAY
+        && millis() - lastTaskFinishedMillisLocal >= SLEEP_DELAY
 #endif
        ) {
       sleepMode = SLEEP;
@@ -172,7 +222,16 @@ void Scheduler::sleepIfRequired() {
       sleepMode = IDLE;
     }
   }
+#ifdef ESP32_DUAL_CORE
+  if (sleepMode == SLEEP && !workerIdle) {
+    // light sleep would stop the task running on the second core
+    sleepMode = IDLE;
+  }
+#endif
   if (sleepMode != NO_SLEEP) {
+#ifdef SLEEP_STATS
+    const unsigned long sleepStartMillis = getMillis();
+#endif
 #ifdef AWAKE_INDICATION_PIN
     digitalWrite(AWAKE_INDICATION_PIN, LOW);
 #endif
@@ -182,12 +241,15 @@ void Scheduler::sleepIfRequired() {
       unsigned long currentSchedulerMillis = getMillis();
 
       unsigned long firstScheduledUptimeMillis = 0;
-      if (first != NULL) {
-        firstScheduledUptimeMillis = first->scheduledUptimeMillis;
+      if (!queueIsEmpty()) {
+        firstScheduledUptimeMillis = nextWakeupMillis();
+#ifdef TIMER_SLACK
+        countSavedWakeups(firstScheduledUptimeMillis);
+#endif
       }
 
       unsigned long maxWaitTimeMillis = 0;
-      if (firstScheduledUptimeMillis > currentSchedulerMillis) {
+      if (timeBefore(currentSchedulerMillis, firstScheduledUptimeMillis)) {
         maxWaitTimeMillis = firstScheduledUptimeMillis - currentSchedulerMillis;
       }
       interrupts();
@@ -199,6 +261,9 @@ void Scheduler::sleepIfRequired() {
     // THE PROGRAM CONTINUES FROM HERE AFTER WAKING UP
 #ifdef AWAKE_INDICATION_PIN
     digitalWrite(AWAKE_INDICATION_PIN, HIGH);
+#endif
+#ifdef SLEEP_STATS
+    sleepStatsAddTime(sleepMode, getMillis() - sleepStartMillis);
 #endif
   }
 }
@@ -208,14 +273,17 @@ inline Scheduler::SleepMode Scheduler::evaluateSleepMode() {
   unsigned long currentSchedulerMillis = getMillis();
 
   unsigned long firstScheduledUptimeMillis = 0;
-  if (first != NULL) {
-    firstScheduledUptimeMillis = first->scheduledUptimeMillis;
+  if (!queueIsEmpty()) {
+    firstScheduledUptimeMillis = nextWakeupMillis();
   }
+#ifdef SLEEP_DELAY
+  const unsigned long lastTaskFinishedMillisLocal = lastTaskFinishedMillis;
+#endif
   interrupts();
 
   SleepMode sleepMode = NO_SLEEP;
   unsigned long maxWaitTimeMillis = 0;
-  if (firstScheduledUptimeMillis > currentSchedulerMillis) {
+  if (timeBefore(currentSchedulerMillis, firstScheduledUptimeMillis)) {
     maxWaitTimeMillis = firstScheduledUptimeMillis - currentSchedulerMillis;
   }
 
@@ -223,7 +291,7 @@ inline Scheduler::SleepMode Scheduler::evaluateSleepMode() {
     sleepMode = NO_SLEEP;
   } else if (!doesSleep() || maxWaitTimeMillis < BUFFER_TIME
 #ifdef SLEEP_DELAY
-             || millis() < lastTaskFinishedMillis + SLEEP_DELAY
+             || millis() - lastTaskFinishedMillisLocal < SLEEP_DELAY
 #endif
             ) {
     // use IDLE for values less then BUFFER_TIME
@@ -234,6 +302,161 @@ inline Scheduler::SleepMode Scheduler::evaluateSleepMode() {
   return sleepMode;
 }
 
+#ifdef ESP32_DUAL_CORE
+// -------------------------------------------------------------------------------------------------
+void Scheduler::schedule(void (*callback)(), const TaskCore core) {
+  Task *newTask = new CallbackTask(callback, getMillis());
+  insertTaskWithCore(newTask, core);
+}
+
+void Scheduler::schedule(Runnable *runnable, const TaskCore core) {
+  Task *newTask = new RunnableTask(runnable, getMillis());
+  insertTaskWithCore(newTask, core);
+}
+
+void Scheduler::scheduleDelayed(void (*callback)(), unsigned long delayMillis, const TaskCore core) {
+  Task *newTask = new CallbackTask(callback, getMillis() + delayMillis);
+  insertTaskWithCore(newTask, core);
+}
+
+void Scheduler::scheduleDelayed(Runnable *runnable, unsigned long delayMillis, const TaskCore core) {
+  Task *newTask = new RunnableTask(runnable, getMillis() + delayMillis);
+  insertTaskWithCore(newTask, core);
+}
+
+void Scheduler::scheduleAt(void (*callback)(), unsigned long uptimeMillis, const TaskCore core) {
+  Task *newTask = new CallbackTask(callback, uptimeMillis);
+  insertTaskWithCore(newTask, core);
+}
+
+void Scheduler::scheduleAt(Runnable *runnable, unsigned long uptimeMillis, const TaskCore core) {
+  Task *newTask = new RunnableTask(runnable, uptimeMillis);
+  insertTaskWithCore(newTask, core);
+}
+
+void Scheduler::insertTaskWithCore(Task *newTask, const TaskCore core) {
+  if (newTask == NULL) {
+    // out of memory
+    return;
+  }
+  newTask->core = core;
+  insertTask(newTask);
+}
+
+/**
+  Starts the worker task on the other core than the one calling execute().
+  It runs with the same FreeRTOS priority.
+*/
+void Scheduler::workerStart() {
+  if (workerTaskHandle != NULL) {
+    return;
+  }
+  mainCore = xPortGetCoreID();
+  xTaskCreatePinnedToCore(workerLoop, "DeepSleepScheduler", ESP32_DUAL_CORE_STACK_SIZE, NULL,
+                          uxTaskPriorityGet(NULL), &workerTaskHandle, 1 - mainCore);
+}
+
+void Scheduler::workerLoop(void *) {
+  while (true) {
+    // notified by executeNextIfTime() when it handed over tasks
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    bool hasExecuted = scheduler.workerExecuteNext();
+    while (hasExecuted) {
+      hasExecuted = scheduler.workerExecuteNext();
+    }
+  }
+}
+
+bool Scheduler::workerExecuteNext() {
+  noInterrupts();
+  workerCurrent = workerQueueRemoveFirst();
+#ifdef TRACE_BUFFER_SIZE
+  if (workerCurrent != NULL) {
+    traceTask(TRACE_TASK_START, workerCurrent);
+  }
+#endif
+  interrupts();
+
+  if (workerCurrent != NULL) {
+    runTask(workerCurrent);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+bool Scheduler::runsOnMainCore(Task *task) const {
+  return task->core == TASK_CORE_MAIN || task->core == mainCore;
+}
+
+bool Scheduler::workerIsIdle() const {
+  return workerFirst == NULL && workerCurrent == NULL;
+}
+
+// The task counts as running from now on and is not in the run queue any more.
+void Scheduler::workerQueueAppend(Task *task) {
+#ifdef TASK_CALLBACK_INDEX_SIZE
+  indexRemove(task);
+#endif
+  task->handedOver = true;
+  task->next = NULL;
+  if (workerLast == NULL) {
+    workerFirst = task;
+  } else {
+    workerLast->next = task;
+  }
+  workerLast = task;
+}
+
+Scheduler::Task *Scheduler::workerQueueRemoveFirst() {
+  Task *task = workerFirst;
+  if (task != NULL) {
+    workerFirst = task->next;
+    if (workerFirst == NULL) {
+      workerLast = NULL;
+    }
+    task->handedOver = false;
+  }
+  return task;
+}
+
+// Removes the first task that can run on both cores.
+Scheduler::Task *Scheduler::workerQueueStealAny() {
+  Task *previousTask = NULL;
+  Task *task = workerFirst;
+  while (task != NULL && task->core != TASK_CORE_ANY) {
+    previousTask = task;
+    task = task->next;
+  }
+  if (task != NULL) {
+    if (previousTask == NULL) {
+      workerFirst = task->next;
+    } else {
+      previousTask->next = task->next;
+    }
+    if (workerLast == task) {
+      workerLast = previousTask;
+    }
+    task->handedOver = false;
+  }
+  return task;
+}
+
+#ifdef PERIODIC_TASKS
+// Tasks handed over to the second core still run once but are not scheduled again.
+void Scheduler::workerStopPeriodic(Task *task) {
+  if (workerCurrent != NULL && workerCurrent->equalCallback(task)) {
+    workerCurrent->periodMillis = 0;
+  }
+  for (Task *handedOverTask = workerFirst; handedOverTask != NULL; handedOverTask = handedOverTask->next) {
+    if (handedOverTask->equalCallback(task)) {
+      handedOverTask->periodMillis = 0;
+    }
+  }
+}
+#endif
+#endif
+
 #ifdef ESP32
 // -------------------------------------------------------------------------------------------------
 void Scheduler::sleep(unsigned long durationMs, bool queueEmpty) {
@@ -252,7 +475,23 @@ void Scheduler::sleep(unsigned long durationMs, bool queueEmpty) {
     timerWakeup = true;
   }
 
+#ifdef TRACE_BUFFER_SIZE
+  noInterrupts();
+  traceRecord(TRACE_SLEEP_ENTER, 0, durationMs);
+  interrupts();
+#endif
   esp_light_sleep_start();
+#if defined(SLEEP_STATS) || defined(TRACE_BUFFER_SIZE)
+  const bool wakeupByTimer = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+#endif
+#ifdef SLEEP_STATS
+  sleepStatsAddWakeup(wakeupByTimer);
+#endif
+#ifdef TRACE_BUFFER_SIZE
+  noInterrupts();
+  traceRecord(TRACE_SLEEP_EXIT, 0, !wakeupByTimer);
+  interrupts();
+#endif
 
   if (timerWakeup) {
     esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
@@ -271,8 +510,22 @@ void Scheduler::sleep(unsigned long durationMs, bool queueEmpty) {
     durationMs = ESP8266_MAX_DELAY_TIME_MS;
   }
 
+#ifdef TRACE_BUFFER_SIZE
+  noInterrupts();
+  traceRecord(TRACE_SLEEP_ENTER, 0, durationMs);
+  interrupts();
+#endif
   delay(durationMs);
   ESP.wdtFeed();
+#ifdef TRACE_BUFFER_SIZE
+  noInterrupts();
+  traceRecord(TRACE_SLEEP_EXIT, 0, 0);
+  interrupts();
+#endif
+#ifdef SLEEP_STATS
+  // delay() only returns when the time is over
+  sleepStatsAddWakeup(true);
+#endif
 }
 #endif
 // -------------------------------------------------------------------------------------------------
@@ -0,0 +1,43 @@
+// -------------------------------------------------------------------------------------------------
+// Definition of the binary min-heap run queue, included inside of class Scheduler
+// -------------------------------------------------------------------------------------------------
+
+// values changeable by the user
+#ifndef TASK_QUEUE_HEAP_SIZE
+#ifdef TASK_POOL_SIZE
+#define TASK_QUEUE_HEAP_SIZE TASK_POOL_SIZE
+#else
+#define TASK_QUEUE_HEAP_SIZE 32
+#endif
+#endif
+
+private:
+/**
+  binary min-heap of the scheduled tasks, heap[0] is the next to run
+*/
+Task *heap[TASK_QUEUE_HEAP_SIZE];
+unsigned int heapSize;
+/**
+  incremented on every insert to keep FIFO order of tasks with the same time
+*/
+unsigned long heapSequence;
+unsigned int taskQueueOverflowCount;
+
+inline void queueInit();
+inline bool queueIsEmpty() const;
+inline Task *queuePeek() const;
+inline Task *queueRemoveFirstIfDue(const unsigned long currentMillis);
+inline bool queueInsert(Task *newTask);
+inline bool queueInsertAtFront(Task *newTask);
+inline bool queueInsertAfter(Task *newTask, Task *previousTask);
+inline bool queueContainsEqual(Task *task) const;
+inline void queueRemoveEqual(Task *task);
+inline void queueRemove(Task *task);
+template <class Visitor> void queueVisitUntil(Visitor &visitor);
+
+inline bool heapBefore(const Task *task, const Task *otherTask) const;
+inline bool heapAdd(Task *newTask);
+inline void heapRemoveAt(const unsigned int index);
+inline void heapSiftUp(unsigned int index);
+inline void heapSiftDown(unsigned int index);
+template <class Visitor> void heapVisitUntil(const unsigned int index, Visitor &visitor);
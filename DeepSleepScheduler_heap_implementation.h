@@ -0,0 +1,183 @@
+#ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
+// -------------------------------------------------------------------------------------------------
+// Implementation (usuallly in CPP file)
+// -------------------------------------------------------------------------------------------------
+
+void Scheduler::queueInit() {
+  heapSize = 0;
+  heapSequence = 0;
+  taskQueueOverflowCount = 0;
+}
+
+unsigned int Scheduler::getTaskQueueOverflowCount() const {
+  noInterrupts();
+  const unsigned int count = taskQueueOverflowCount;
+  interrupts();
+  return count;
+}
+
+bool Scheduler::queueIsEmpty() const {
+  return heapSize == 0;
+}
+
+Scheduler::Task *Scheduler::queuePeek() const {
+  if (heapSize == 0) {
+    return NULL;
+  }
+  return heap[0];
+}
+
+Scheduler::Task *Scheduler::queueRemoveFirstIfDue(const unsigned long currentMillis) {
+  if (heapSize == 0 || timeBefore(currentMillis, heap[0]->scheduledUptimeMillis)) {
+    return NULL;
+  }
+  Task *task = heap[0];
+  heapRemoveAt(0);
+  return task;
+}
+
+bool Scheduler::queueInsert(Task *newTask) {
+  newTask->atFrontOfQueue = false;
+  return heapAdd(newTask);
+}
+
+bool Scheduler::queueInsertAtFront(Task *newTask) {
+  newTask->atFrontOfQueue = true;
+  return heapAdd(newTask);
+}
+
+// The position in the heap does not depend on other tasks, so previousTask is not needed.
+bool Scheduler::queueInsertAfter(Task *newTask, Task *) {
+  return queueInsert(newTask);
+}
+
+bool Scheduler::queueContainsEqual(Task *task) const {
+  for (unsigned int i = 0; i < heapSize; i++) {
+    if (heap[i]->equalCallback(task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Scheduler::queueRemoveEqual(Task *task) {
+  unsigned int remaining = 0;
+  for (unsigned int i = 0; i < heapSize; i++) {
+    if (heap[i]->equalCallback(task)) {
+      delete heap[i];
+    } else {
+      heap[remaining] = heap[i];
+      heap[remaining]->heapIndex = remaining;
+      remaining++;
+    }
+  }
+  if (remaining != heapSize) {
+    heapSize = remaining;
+    // restore the heap property bottom-up
+    for (unsigned int i = heapSize / 2; i > 0; i--) {
+      heapSiftDown(i - 1);
+    }
+  }
+}
+
+void Scheduler::queueRemove(Task *task) {
+  heapRemoveAt(task->heapIndex);
+}
+
+template <class Visitor> void Scheduler::queueVisitUntil(Visitor &visitor) {
+  heapVisitUntil(0, visitor);
+}
+
+// Tasks at front of queue come first with the last inserted one first.
+// All others are ordered by time and in FIFO order if the time is equal.
+bool Scheduler::heapBefore(const Task *task, const Task *otherTask) const {
+  if (task->atFrontOfQueue != otherTask->atFrontOfQueue) {
+    return task->atFrontOfQueue;
+  }
+  if (!task->atFrontOfQueue && task->scheduledUptimeMillis != otherTask->scheduledUptimeMillis) {
+    return timeBefore(task->scheduledUptimeMillis, otherTask->scheduledUptimeMillis);
+  }
+  // signed difference to stay correct when the sequence overflows
+  const long sequenceDifference = (long)(task->sequence - otherTask->sequence);
+  if (task->atFrontOfQueue) {
+    return sequenceDifference > 0;
+  } else {
+    return sequenceDifference < 0;
+  }
+}
+
+bool Scheduler::heapAdd(Task *newTask) {
+  if (heapSize >= TASK_QUEUE_HEAP_SIZE) {
+    taskQueueOverflowCount++;
+    return false;
+  }
+  newTask->sequence = heapSequence++;
+  heap[heapSize] = newTask;
+  heapSiftUp(heapSize);
+  heapSize++;
+  return true;
+}
+
+void Scheduler::heapRemoveAt(const unsigned int index) {
+  heapSize--;
+  if (index < heapSize) {
+    // move the last one to the free index and restore the heap property
+    Task *movedTask = heap[heapSize];
+    heap[index] = movedTask;
+    heapSiftDown(index);
+    heapSiftUp(movedTask->heapIndex);
+  }
+}
+
+void Scheduler::heapSiftUp(unsigned int index) {
+  Task *task = heap[index];
+  while (index > 0) {
+    const unsigned int parent = (index - 1) / 2;
+    if (!heapBefore(task, heap[parent])) {
+      break;
+    }
+    heap[index] = heap[parent];
+    heap[index]->heapIndex = index;
+    index = parent;
+  }
+  heap[index] = task;
+  task->heapIndex = index;
+}
+
+void Scheduler::heapSiftDown(unsigned int index) {
+  Task *task = heap[index];
+  while (true) {
+    unsigned int child = 2 * index + 1;
+    if (child >= heapSize) {
+      break;
+    }
+    if (child + 1 < heapSize && heapBefore(heap[child + 1], heap[child])) {
+      child++;
+    }
+    if (!heapBefore(heap[child], task)) {
+      break;
+    }
+    heap[index] = heap[child];
+    heap[index]->heapIndex = index;
+    index = child;
+  }
+  heap[index] = task;
+  task->heapIndex = index;
+}
+
+// Visits the task at index and its children as long as they are not after visitor.limit.
+template <class Visitor> void Scheduler::heapVisitUntil(const unsigned int index, Visitor &visitor) {
+  if (index >= heapSize) {
+    return;
+  }
+  Task *task = heap[index];
+  // children of a task not at front of queue are not before it
+  if (!task->atFrontOfQueue && timeBefore(visitor.limit, task->scheduledUptimeMillis)) {
+    return;
+  }
+  visitor.visit(task);
+  heapVisitUntil(2 * index + 1, visitor);
+  heapVisitUntil(2 * index + 2, visitor);
+}
+
+#endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
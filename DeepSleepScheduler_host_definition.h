@@ -0,0 +1,39 @@
+
+// -------------------------------------------------------------------------------------------------
+// Definition of the host simulation, included inside of class Scheduler
+// -------------------------------------------------------------------------------------------------
+
+private:
+void init();
+public:
+/**
+  Runs the tasks like execute() but returns as soon as the uptime reaches uptimeMillis.
+  While the CPU sleeps, the virtual clock jumps to the next task or simulated interrupt,
+  so days of scheduler behaviour run within milliseconds.
+  Only available in the host simulation.
+  @param uptimeMillis: the uptime at which it returns
+*/
+void executeUntil(const unsigned long uptimeMillis);
+/**
+  Do not call this method, it is used by the simulated watchdog.
+*/
+static void isrWdt();
+private:
+/**
+   The uptime at which executeUntil() returns, the CPU does not sleep beyond it.
+*/
+unsigned long sleepLimitMillis;
+bool sleepLimited;
+
+void taskWdtEnable(const uint8_t value);
+void taskWdtDisable();
+inline unsigned long wdtTimeoutToDurationMs(const uint8_t value);
+void sleepIfRequired();
+inline SleepMode evaluateSleepMode();
+
+// unused here, only used for AVR
+bool isWakeupByOtherInterrupt() {
+  return false;
+}
+void wdtEnableInterrupt() {}
+
@@ -0,0 +1,343 @@
+
+#ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
+// -------------------------------------------------------------------------------------------------
+// Implementation (usuallly in CPP file)
+// -------------------------------------------------------------------------------------------------
+
+// simulated hardware
+uint64_t hostClockMicros = 0;
+bool hostInterruptsEnabled = true;
+uint64_t hostNextInterruptMicros = UINT64_MAX;
+byte hostPins[HOST_PIN_COUNT];
+HostSerial Serial;
+
+static void (*hostPendingIsrs[HOST_MAX_PENDING_INTERRUPTS])();
+static uint64_t hostPendingMicros[HOST_MAX_PENDING_INTERRUPTS];
+static byte hostPendingCount = 0;
+static bool hostInterruptRunning = false;
+static uint64_t hostWdtTimeoutMicros = 0;
+static uint64_t hostWdtDeadlineMicros = UINT64_MAX;
+static void (*hostWdtIsr)() = NULL;
+
+void hostAdvanceMicros(const uint64_t durationMicros) {
+  const uint64_t targetMicros = hostClockMicros + durationMicros;
+  while (true) {
+    uint64_t eventMicros = hostWdtDeadlineMicros;
+    if (hostInterruptsEnabled && !hostInterruptRunning && hostNextInterruptMicros < eventMicros) {
+      eventMicros = hostNextInterruptMicros;
+    }
+    if (eventMicros > targetMicros) {
+      break;
+    }
+    if (eventMicros > hostClockMicros) {
+      hostClockMicros = eventMicros;
+    }
+    if (hostWdtDeadlineMicros <= hostClockMicros) {
+      hostWdtDeadlineMicros = UINT64_MAX;
+      hostWdtIsr();
+    } else {
+      hostRunDueInterrupts();
+    }
+  }
+  hostClockMicros = targetMicros;
+}
+
+bool hostScheduleInterrupt(void (*isr)(), const unsigned long delayMillis) {
+  if (hostPendingCount == HOST_MAX_PENDING_INTERRUPTS) {
+    return false;
+  }
+  const uint64_t interruptMicros = hostClockMicros + (uint64_t) delayMillis * 1000;
+  hostPendingIsrs[hostPendingCount] = isr;
+  hostPendingMicros[hostPendingCount] = interruptMicros;
+  hostPendingCount++;
+  if (interruptMicros < hostNextInterruptMicros) {
+    hostNextInterruptMicros = interruptMicros;
+  }
+  return true;
+}
+
+void hostRunDueInterrupts() {
+  // interrupts enabled within an interrupt do not nest
+  while (hostInterruptsEnabled && !hostInterruptRunning && hostNextInterruptMicros <= hostClockMicros) {
+    // remove the earliest interrupt and find the next one
+    void (*isr)() = NULL;
+    uint64_t nextMicros = UINT64_MAX;
+    for (byte i = 0; i < hostPendingCount; i++) {
+      if (isr == NULL && hostPendingMicros[i] == hostNextInterruptMicros) {
+        isr = hostPendingIsrs[i];
+        hostPendingCount--;
+        hostPendingIsrs[i] = hostPendingIsrs[hostPendingCount];
+        hostPendingMicros[i] = hostPendingMicros[hostPendingCount];
+        if (i == hostPendingCount) {
+          break;
+        }
+      }
+      if (hostPendingMicros[i] < nextMicros) {
+        nextMicros = hostPendingMicros[i];
+      }
+    }
+    hostNextInterruptMicros = nextMicros;
+
+    hostInterruptRunning = true;
+    hostInterruptsEnabled = false;
+    isr();
+    hostInterruptsEnabled = true;
+    hostInterruptRunning = false;
+  }
+}
+
+bool hostSleep(const unsigned long maxMillis) {
+  const uint64_t wakeupMicros = maxMillis == 0 ? UINT64_MAX : hostClockMicros + (uint64_t) maxMillis * 1000;
+  const bool wakeupByInterrupt = hostNextInterruptMicros < wakeupMicros;
+  const uint64_t endMicros = wakeupByInterrupt ? hostNextInterruptMicros : wakeupMicros;
+  if (endMicros == UINT64_MAX) {
+    // a real CPU would never wake up again
+    fprintf(stderr, "Host simulation ended, sleeping without pending interrupt\n");
+    exit(EXIT_SUCCESS);
+  }
+  if (endMicros > hostClockMicros) {
+    // runs the interrupt at its time as well
+    hostAdvanceMicros(endMicros - hostClockMicros);
+  } else {
+    hostRunDueInterrupts();
+  }
+  return wakeupByInterrupt;
+}
+
+void hostWdtEnable(const unsigned long timeoutMillis, void (*isr)()) {
+  hostWdtIsr = isr;
+  hostWdtTimeoutMicros = (uint64_t) timeoutMillis * 1000;
+  hostWdtDeadlineMicros = hostClockMicros + hostWdtTimeoutMicros;
+}
+
+void hostWdtDisable() {
+  hostWdtDeadlineMicros = UINT64_MAX;
+}
+
+void hostWdtReset() {
+  if (hostWdtDeadlineMicros != UINT64_MAX) {
+    hostWdtDeadlineMicros = hostClockMicros + hostWdtTimeoutMicros;
+  }
+}
+
+// scheduler
+void Scheduler::init() {
+  sleepLimitMillis = 0;
+  sleepLimited = false;
+}
+
+unsigned long Scheduler::getMillis() const {
+  return millis();
+}
+
+#ifdef TRACE_BUFFER_SIZE
+unsigned long Scheduler::traceMillis() {
+  return millis();
+}
+#endif
+
+void Scheduler::taskWdtEnable(const uint8_t value) {
+  if (value != NO_SUPERVISION) {
+    hostWdtEnable(wdtTimeoutToDurationMs(value), isrWdt);
+  }
+}
+
+void Scheduler::taskWdtDisable() {
+  hostWdtDisable();
+}
+
+void Scheduler::taskWdtReset() {
+  hostWdtReset();
+}
+
+void Scheduler::isrWdt() {
+#ifdef TRACE_BUFFER_SIZE
+  traceRecord(TRACE_SUPERVISION_TIMEOUT, 0, 0);
+#endif
+#ifdef SUPERVISION_CALLBACK
+  if (supervisionCallbackRunnable != NULL) {
+    supervisionCallbackRunnable->run();
+  }
+#endif
+  fprintf(stderr, "Watchdog abort by DeepSleepScheduler\n");
+  abort();
+}
+
+void Scheduler::executeUntil(const unsigned long uptimeMillis) {
+  setupTaskTimeoutIfConfigured();
+  sleepLimitMillis = uptimeMillis;
+  sleepLimited = true;
+  while (timeBefore(getMillis(), uptimeMillis)) {
+    bool hasExecuted = executeNextIfTime();
+    // also stop when tasks are due all the time, e.g. a periodic task that runs as long as its period
+    while (hasExecuted && timeBefore(getMillis(), uptimeMillis)) {
+      hasExecuted = executeNextIfTime();
+    }
+
+    sleepIfRequired();
+    reactivateTaskTimeoutIfRequired();
+    // detects when getMillis() wraps
+    getMillis64();
+  }
+  sleepLimited = false;
+}
+
+void Scheduler::sleepIfRequired() {
+  noInterrupts();
+  bool queueEmpty = queueIsEmpty();
+  interrupts();
+  SleepMode sleepMode = IDLE;
+#ifdef SUBMISSION_RING_SIZE
+  if (!submissionRingIsEmpty()) {
+    // an interrupt scheduled a task that is not in the run queue yet
+    sleepMode = NO_SLEEP;
+  } else
+#endif
+  if (!queueEmpty) {
+    sleepMode = evaluateSleepMode();
+  } else {
+    // nothing in the queue
+    if (doesSleep()
+#ifdef SLEEP_DELAY
+        && timeDifference(millis(), lastTaskFinishedMillis) >= SLEEP_DELAY
+#endif
+       ) {
+      sleepMode = SLEEP;
+    } else {
+      sleepMode = IDLE;
+    }
+  }
+  if (sleepMode == NO_SLEEP) {
+    return;
+  }
+
+  // The virtual clock jumps to the end of the wait, so idle mode waits like sleep.
+  // 0 waits until an interrupt occurs.
+  const unsigned long currentSchedulerMillis = getMillis();
+  unsigned long maxWaitTimeMillis = 0;
+  noInterrupts();
+  if (!queueIsEmpty()) {
+    const unsigned long firstScheduledUptimeMillis = nextWakeupMillis();
+#ifdef TIMER_SLACK
+    if (sleepMode == SLEEP) {
+      countSavedWakeups(firstScheduledUptimeMillis);
+    }
+#endif
+    if (!timeBefore(currentSchedulerMillis, firstScheduledUptimeMillis)) {
+      // an interrupt scheduled a task in the meantime
+      interrupts();
+      return;
+    }
+    maxWaitTimeMillis = timeDifference(firstScheduledUptimeMillis, currentSchedulerMillis);
+  }
+  interrupts();
+#ifdef SLEEP_DELAY
+  const unsigned long sinceLastTaskMillis = timeDifference(millis(), lastTaskFinishedMillis);
+  if (sleepMode == IDLE && sinceLastTaskMillis < SLEEP_DELAY
+      && (maxWaitTimeMillis == 0 || SLEEP_DELAY - sinceLastTaskMillis < maxWaitTimeMillis)) {
+    // wake up when deep sleep is allowed
+    maxWaitTimeMillis = SLEEP_DELAY - sinceLastTaskMillis;
+  }
+#endif
+  if (sleepLimited) {
+    if (!timeBefore(currentSchedulerMillis, sleepLimitMillis)) {
+      return;
+    }
+    if (maxWaitTimeMillis == 0 || timeDifference(sleepLimitMillis, currentSchedulerMillis) < maxWaitTimeMillis) {
+      maxWaitTimeMillis = timeDifference(sleepLimitMillis, currentSchedulerMillis);
+    }
+  }
+
+  // execute() resets the task WDT during the wait on a real CPU
+  taskWdtDisable();
+#ifdef AWAKE_INDICATION_PIN
+  digitalWrite(AWAKE_INDICATION_PIN, LOW);
+#endif
+#ifdef TRACE_BUFFER_SIZE
+  if (sleepMode == SLEEP) {
+    noInterrupts();
+    traceRecord(TRACE_SLEEP_ENTER, 0, maxWaitTimeMillis);
+    interrupts();
+  }
+#endif
+#if defined(SLEEP_STATS) || defined(TRACE_BUFFER_SIZE)
+  const bool wakeupByInterrupt = hostSleep(maxWaitTimeMillis);
+#else
+  hostSleep(maxWaitTimeMillis);
+#endif
+  // THE PROGRAM CONTINUES FROM HERE AFTER WAKING UP
+#ifdef TRACE_BUFFER_SIZE
+  if (sleepMode == SLEEP) {
+    noInterrupts();
+    traceRecord(TRACE_SLEEP_EXIT, 0, wakeupByInterrupt);
+    interrupts();
+  }
+#endif
+#ifdef SLEEP_STATS
+  if (sleepMode == SLEEP) {
+    sleepStatsAddWakeup(!wakeupByInterrupt);
+  }
+  sleepStatsAddTime(sleepMode, timeDifference(getMillis(), currentSchedulerMillis));
+#endif
+#ifdef AWAKE_INDICATION_PIN
+  digitalWrite(AWAKE_INDICATION_PIN, HIGH);
+#endif
+}
+
+inline Scheduler::SleepMode Scheduler::evaluateSleepMode() {
+  noInterrupts();
+  unsigned long currentSchedulerMillis = getMillis();
+
+  unsigned long firstScheduledUptimeMillis = 0;
+  if (!queueIsEmpty()) {
+    firstScheduledUptimeMillis = nextWakeupMillis();
+  }
+  interrupts();
+
+  SleepMode sleepMode = NO_SLEEP;
+  unsigned long maxWaitTimeMillis = 0;
+  if (timeBefore(currentSchedulerMillis, firstScheduledUptimeMillis)) {
+    maxWaitTimeMillis = timeDifference(firstScheduledUptimeMillis, currentSchedulerMillis);
+  }
+
+  if (maxWaitTimeMillis == 0) {
+    sleepMode = NO_SLEEP;
+  } else if (!doesSleep() || maxWaitTimeMillis < BUFFER_TIME
+#ifdef SLEEP_DELAY
+             || timeDifference(millis(), lastTaskFinishedMillis) < SLEEP_DELAY
+#endif
+            ) {
+    // use IDLE for values less then BUFFER_TIME
+    sleepMode = IDLE;
+  } else {
+    sleepMode = SLEEP;
+  }
+  return sleepMode;
+}
+
+inline unsigned long Scheduler::wdtTimeoutToDurationMs(const uint8_t value) {
+  switch (value) {
+    case TIMEOUT_15Ms:
+      return 15;
+    case TIMEOUT_30MS:
+      return 30;
+    case TIMEOUT_60MS:
+      return 60;
+    case TIMEOUT_120MS:
+      return 120;
+    case TIMEOUT_250MS:
+      return 250;
+    case TIMEOUT_500MS:
+      return 500;
+    case TIMEOUT_1S:
+      return 1000;
+    case TIMEOUT_2S:
+      return 2000;
+    case TIMEOUT_4S:
+      return 4000;
+    default:
+      return 8000;
+  }
+}
+
+#endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
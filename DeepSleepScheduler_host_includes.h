@@ -0,0 +1,191 @@
+
+// -------------------------------------------------------------------------------------------------
+// Simulated Arduino environment of the host simulation, used instead of Arduino.h when compiled
+// without Arduino, e.g. on Linux. The clock is virtual and only advances in delay(), while the
+// CPU sleeps and by hostAdvanceMillis(), so it is deterministic and sleep times take no real time.
+// -------------------------------------------------------------------------------------------------
+#ifndef DEEP_SLEEP_SCHEDULER_HOST_INCLUDES_H
+#define DEEP_SLEEP_SCHEDULER_HOST_INCLUDES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// values changeable by the user
+#ifndef HOST_MAX_PENDING_INTERRUPTS
+#define HOST_MAX_PENDING_INTERRUPTS 16
+#endif
+#ifndef HOST_PIN_COUNT
+#define HOST_PIN_COUNT 64
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LED_BUILTIN 13
+#define DEC 10
+#define HEX 16
+#define F(string) (string)
+
+// state of the simulated hardware
+extern uint64_t hostClockMicros;
+extern bool hostInterruptsEnabled;
+/**
+   virtual time of the next pending interrupt, UINT64_MAX if none is pending
+*/
+extern uint64_t hostNextInterruptMicros;
+extern byte hostPins[HOST_PIN_COUNT];
+
+/**
+  Advances the virtual clock and runs the interrupts and the watchdog that are due in between.
+  @param durationMicros: the time to advance in microseconds
+*/
+void hostAdvanceMicros(uint64_t durationMicros);
+/**
+  Advances the virtual clock like the CPU was busy for the given time.
+  @param durationMillis: the time to advance in milliseconds
+*/
+inline void hostAdvanceMillis(unsigned long durationMillis) {
+  hostAdvanceMicros((uint64_t) durationMillis * 1000);
+}
+/**
+  Simulates an external interrupt that calls the isr after delayMillis milliseconds of virtual time.
+  @param isr: the interrupt service routine
+  @param delayMillis: the time until the interrupt occurs
+  return: false if HOST_MAX_PENDING_INTERRUPTS interrupts are pending already
+*/
+bool hostScheduleInterrupt(void (*isr)(), unsigned long delayMillis);
+/**
+  Runs the pending interrupts that are due if interrupts are enabled.
+*/
+void hostRunDueInterrupts();
+/**
+  Puts the simulated CPU to sleep until the time is over or an interrupt occurs.
+  Ends the program if it would sleep forever.
+  @param maxMillis: the maximal sleep time, 0 to sleep until an interrupt occurs
+  return: true if an interrupt woke the CPU up
+*/
+bool hostSleep(unsigned long maxMillis);
+/**
+  The simulated watchdog calls the isr when it is not reset within timeoutMillis.
+*/
+void hostWdtEnable(unsigned long timeoutMillis, void (*isr)());
+void hostWdtDisable();
+void hostWdtReset();
+
+// Arduino API on top of the simulated hardware
+// truncated to 32 bits so that they wrap like on the targets also where unsigned long has 64 bits
+inline unsigned long millis() {
+  return (uint32_t) (hostClockMicros / 1000);
+}
+inline unsigned long micros() {
+  return (uint32_t) hostClockMicros;
+}
+inline void delay(unsigned long durationMillis) {
+  hostAdvanceMillis(durationMillis);
+}
+inline void delayMicroseconds(unsigned int durationMicros) {
+  hostAdvanceMicros(durationMicros);
+}
+inline void yield() {}
+inline void noInterrupts() {
+  hostInterruptsEnabled = false;
+}
+inline void interrupts() {
+  hostInterruptsEnabled = true;
+  if (hostClockMicros >= hostNextInterruptMicros) {
+    hostRunDueInterrupts();
+  }
+}
+inline void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < HOST_PIN_COUNT && mode == INPUT_PULLUP) {
+    hostPins[pin] = HIGH;
+  }
+}
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < HOST_PIN_COUNT) {
+    hostPins[pin] = value;
+  }
+}
+inline int digitalRead(uint8_t pin) {
+  return pin < HOST_PIN_COUNT ? hostPins[pin] : LOW;
+}
+
+/**
+  The part of the Arduino Print class used by the library and the examples.
+*/
+class Print {
+  public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t print(const char *string) {
+      size_t count = 0;
+      while (*string != '\0') {
+        count += write(*string++);
+      }
+      return count;
+    }
+    size_t print(char c) {
+      return write(c);
+    }
+    size_t print(unsigned long value, int base = DEC) {
+      char digits[8 * sizeof(value) + 1];
+      char *digit = &digits[sizeof(digits) - 1];
+      *digit = '\0';
+      do {
+        const byte remainder = value % base;
+        *--digit = remainder < 10 ? '0' + remainder : 'A' + remainder - 10;
+        value /= base;
+      } while (value != 0);
+      return print(digit);
+    }
+    size_t print(long value, int base = DEC) {
+      if (value < 0 && base == DEC) {
+        return write('-') + print((unsigned long) - value, base);
+      }
+      return print((unsigned long) value, base);
+    }
+    size_t print(unsigned int value, int base = DEC) {
+      return print((unsigned long) value, base);
+    }
+    size_t print(int value, int base = DEC) {
+      return print((long) value, base);
+    }
+    size_t println() {
+      return write('\n');
+    }
+    template<typename T> size_t println(T value) {
+      const size_t count = print(value);
+      return count + println();
+    }
+    template<typename T> size_t println(T value, int base) {
+      const size_t count = print(value, base);
+      return count + println();
+    }
+};
+
+/**
+  Serial of the host simulation, prints to stdout.
+*/
+class HostSerial : public Print {
+  public:
+    void begin(unsigned long) {}
+    void flush() {
+      fflush(stdout);
+    }
+    size_t write(uint8_t c) {
+      putchar(c);
+      return 1;
+    }
+    operator bool() {
+      return true;
+    }
+};
+extern HostSerial Serial;
+
+#endif // #ifndef DEEP_SLEEP_SCHEDULER_HOST_INCLUDES_H
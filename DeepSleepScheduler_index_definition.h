@@ -0,0 +1,20 @@
+// -------------------------------------------------------------------------------------------------
+// Definition of the callback index, included inside of class Scheduler
+// -------------------------------------------------------------------------------------------------
+// Hash table with linear probing. Every entry is the first of a linked list of all scheduled
+// tasks with the same callback or Runnable.
+
+private:
+Task *taskIndex[TASK_CALLBACK_INDEX_SIZE];
+unsigned int taskIndexCount;
+unsigned int taskCallbackIndexOverflowCount;
+
+// These methods are called with interrupts disabled
+inline void indexInit();
+inline bool indexAdd(Task *task);
+inline void indexRemove(Task *task);
+inline bool indexContainsEqual(Task *task) const;
+inline void indexRemoveEqual(Task *task);
+inline unsigned int indexFind(Task *task) const;
+inline void indexRemoveEntry(unsigned int entry);
+static inline unsigned int indexHash(Task *task);
@@ -0,0 +1,116 @@
+#ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
+// -------------------------------------------------------------------------------------------------
+// Implementation (usuallly in CPP file)
+// -------------------------------------------------------------------------------------------------
+
+void Scheduler::indexInit() {
+  for (unsigned int i = 0; i < TASK_CALLBACK_INDEX_SIZE; i++) {
+    taskIndex[i] = NULL;
+  }
+  taskIndexCount = 0;
+  taskCallbackIndexOverflowCount = 0;
+}
+
+unsigned int Scheduler::getTaskCallbackIndexOverflowCount() const {
+  noInterrupts();
+  const unsigned int count = taskCallbackIndexOverflowCount;
+  interrupts();
+  return count;
+}
+
+bool Scheduler::indexAdd(Task *task) {
+  const unsigned int entry = indexFind(task);
+  Task *first = taskIndex[entry];
+  if (first == NULL) {
+    if (taskIndexCount >= TASK_CALLBACK_INDEX_SIZE - 1) {
+      // keep one entry free so indexFind() terminates
+      taskCallbackIndexOverflowCount++;
+      return false;
+    }
+    taskIndexCount++;
+  } else {
+    first->indexPrevious = task;
+  }
+  task->indexPrevious = NULL;
+  task->indexNext = first;
+  taskIndex[entry] = task;
+  return true;
+}
+
+void Scheduler::indexRemove(Task *task) {
+  if (task->indexNext != NULL) {
+    task->indexNext->indexPrevious = task->indexPrevious;
+  }
+  if (task->indexPrevious != NULL) {
+    task->indexPrevious->indexNext = task->indexNext;
+  } else {
+    const unsigned int entry = indexFind(task);
+    if (task->indexNext != NULL) {
+      taskIndex[entry] = task->indexNext;
+    } else {
+      indexRemoveEntry(entry);
+    }
+  }
+}
+
+bool Scheduler::indexContainsEqual(Task *task) const {
+  return taskIndex[indexFind(task)] != NULL;
+}
+
+void Scheduler::indexRemoveEqual(Task *task) {
+  const unsigned int entry = indexFind(task);
+  Task *currentTask = taskIndex[entry];
+  if (currentTask != NULL) {
+    while (currentTask != NULL) {
+      Task *taskToDelete = currentTask;
+      currentTask = currentTask->indexNext;
+      unlinkTask(taskToDelete);
+      delete taskToDelete;
+    }
+    indexRemoveEntry(entry);
+  }
+}
+
+// Returns the entry of the callback of the task or the free entry where it is to be added.
+unsigned int Scheduler::indexFind(Task *task) const {
+  unsigned int entry = indexHash(task);
+  while (taskIndex[entry] != NULL && !taskIndex[entry]->equalCallback(task)) {
+    entry++;
+    if (entry == TASK_CALLBACK_INDEX_SIZE) {
+      entry = 0;
+    }
+  }
+  return entry;
+}
+
+// Frees the entry and moves following entries back so that indexFind() still finds them.
+void Scheduler::indexRemoveEntry(unsigned int entry) {
+  taskIndexCount--;
+  unsigned int nextEntry = entry;
+  while (true) {
+    nextEntry++;
+    if (nextEntry == TASK_CALLBACK_INDEX_SIZE) {
+      nextEntry = 0;
+    }
+    if (taskIndex[nextEntry] == NULL) {
+      break;
+    }
+    // keep it if its hash is cyclically between the free entry and where it is now
+    const unsigned int hash = indexHash(taskIndex[nextEntry]);
+    const bool keep = entry <= nextEntry
+                      ? entry < hash && hash <= nextEntry
+                      : entry < hash || hash <= nextEntry;
+    if (!keep) {
+      taskIndex[entry] = taskIndex[nextEntry];
+      entry = nextEntry;
+    }
+  }
+  taskIndex[entry] = NULL;
+}
+
+unsigned int Scheduler::indexHash(Task *task) {
+  const uintptr_t key = task->callbackKey();
+  return (key ^ (key >> 4)) % TASK_CALLBACK_INDEX_SIZE;
+}
+
+#endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
@@ -0,0 +1,24 @@
+// -------------------------------------------------------------------------------------------------
+// Definition of the sorted linked list run queue, included inside of class Scheduler
+// -------------------------------------------------------------------------------------------------
+
+private:
+/**
+  first element in the run queue
+*/
+Task *first;
+
+inline void queueInit();
+inline bool queueIsEmpty() const;
+inline Task *queuePeek() const;
+inline Task *queueRemoveFirstIfDue(const unsigned long currentMillis);
+inline bool queueInsert(Task *newTask);
+inline bool queueInsertAtFront(Task *newTask);
+inline bool queueInsertAfter(Task *newTask, Task *previousTask);
+inline bool queueContainsEqual(Task *task) const;
+inline void queueRemoveEqual(Task *task);
+inline void queueRemove(Task *task);
+template <class Visitor> void queueVisitUntil(Visitor &visitor);
+
+inline void listLink(Task *newTask, Task *previousTask);
+inline void listUnlink(Task *task, Task *previousTask);
@@ -0,0 +1,142 @@
+#ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
+// -------------------------------------------------------------------------------------------------
+// Implementation (usuallly in CPP file)
+// -------------------------------------------------------------------------------------------------
+
+void Scheduler::queueInit() {
+  first = NULL;
+}
+
+bool Scheduler::queueIsEmpty() const {
+  return first == NULL;
+}
+
+Scheduler::Task *Scheduler::queuePeek() const {
+  return first;
+}
+
+Scheduler::Task *Scheduler::queueRemoveFirstIfDue(const unsigned long currentMillis) {
+  Task *task = NULL;
+  if (first != NULL && !timeBefore(currentMillis, first->scheduledUptimeMillis)) {
+    task = first;
+    listUnlink(task, NULL);
+  }
+  return task;
+}
+
+bool Scheduler::queueInsert(Task *newTask) {
+  if (first == NULL || timeBefore(newTask->scheduledUptimeMillis, first->scheduledUptimeMillis)) {
+    // insert before first
+    listLink(newTask, NULL);
+  } else {
+    Task *previousTask = first;
+    while (previousTask->next != NULL
+           && !timeBefore(newTask->scheduledUptimeMillis, previousTask->next->scheduledUptimeMillis)) {
+      previousTask = previousTask->next;
+    }
+    listLink(newTask, previousTask);
+  }
+  return true;
+}
+
+bool Scheduler::queueInsertAtFront(Task *newTask) {
+  listLink(newTask, NULL);
+  return true;
+}
+
+bool Scheduler::queueInsertAfter(Task *newTask, Task *previousTask) {
+  if (previousTask == NULL) {
+    return queueInsert(newTask);
+  }
+  while (previousTask->next != NULL
+         && !timeBefore(newTask->scheduledUptimeMillis, previousTask->next->scheduledUptimeMillis)) {
+    previousTask = previousTask->next;
+  }
+  listLink(newTask, previousTask);
+  return true;
+}
+
+bool Scheduler::queueContainsEqual(Task *task) const {
+  Task *currentTask = first;
+  while (currentTask != NULL) {
+    if (currentTask->equalCallback(task)) {
+      return true;
+    }
+    currentTask = currentTask->next;
+  }
+  return false;
+}
+
+void Scheduler::queueRemoveEqual(Task *task) {
+  Task *previousTask = NULL;
+  Task *currentTask = first;
+  while (currentTask != NULL) {
+    if (currentTask->equalCallback(task)) {
+      Task *taskToDelete = currentTask;
+      listUnlink(taskToDelete, previousTask);
+      currentTask = taskToDelete->next;
+      delete taskToDelete;
+    } else {
+      previousTask = currentTask;
+      currentTask = currentTask->next;
+    }
+  }
+}
+
+#ifdef TASK_QUEUE_LIST_PREVIOUS
+void Scheduler::queueRemove(Task *task) {
+  listUnlink(task, task->previous);
+}
+#else
+// Takes O(n) as the list is singly linked.
+void Scheduler::queueRemove(Task *task) {
+  if (first == task) {
+    listUnlink(task, NULL);
+  } else {
+    Task *previousTask = first;
+    while (previousTask != NULL && previousTask->next != task) {
+      previousTask = previousTask->next;
+    }
+    if (previousTask != NULL) {
+      listUnlink(task, previousTask);
+    }
+  }
+}
+#endif
+
+template <class Visitor> void Scheduler::queueVisitUntil(Visitor &visitor) {
+  Task *task = first;
+  while (task != NULL && !timeBefore(visitor.limit, task->scheduledUptimeMillis)) {
+    visitor.visit(task);
+    task = task->next;
+  }
+}
+
+// Inserts newTask after previousTask or as first task if previousTask is NULL.
+void Scheduler::listLink(Task *newTask, Task *previousTask) {
+  Task **position = previousTask == NULL ? &first : &previousTask->next;
+  newTask->next = *position;
+#ifdef TASK_QUEUE_LIST_PREVIOUS
+  newTask->previous = previousTask;
+  if (newTask->next != NULL) {
+    newTask->next->previous = newTask;
+  }
+#endif
+  *position = newTask;
+}
+
+// Removes the task that follows previousTask or is the first task if previousTask is NULL.
+void Scheduler::listUnlink(Task *task, Task *previousTask) {
+  if (previousTask == NULL) {
+    first = task->next;
+  } else {
+    previousTask->next = task->next;
+  }
+#ifdef TASK_QUEUE_LIST_PREVIOUS
+  if (task->next != NULL) {
+    task->next->previous = previousTask;
+  }
+#endif
+}
+
+#endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
@@ -0,0 +1,38 @@
+// -------------------------------------------------------------------------------------------------
+// Definition of the ready lists of TASK_PRIORITIES and TASK_DEADLINES, included inside of class Scheduler
+// -------------------------------------------------------------------------------------------------
+// Due tasks are moved from the run queue to the list of their priority in the order of the run
+// queue. Bit n of readyBitmap is set while the list of priority n is not empty, so the next task
+// is found without looking at the lists. Within a list, tasks of scheduleAtFrontOfQueue() come
+// first, then tasks with a deadline ordered by it and then the other tasks.
+
+#ifndef TASK_PRIORITIES
+// all tasks are in the same list
+#define TASK_PRIORITY_COUNT 1
+#endif
+
+private:
+Task *readyFirst[TASK_PRIORITY_COUNT];
+Task *readyLast[TASK_PRIORITY_COUNT];
+byte readyBitmap;
+
+#ifdef TASK_PRIORITIES
+void insertTaskWithPriority(Task *newTask, const TaskPriority priority, const bool removeExisting);
+#endif
+#ifdef TASK_DEADLINES
+void insertTaskWithDeadline(Task *newTask, const unsigned long deadlineMillis);
+inline void checkDeadline(Task *task);
+void (*deadlineMissCallback)(void (*callback)(), Runnable *runnable, unsigned long lateMillis);
+unsigned long deadlineMissCount;
+unsigned long maxDeadlineMissMillis;
+#endif
+
+// These methods are called with interrupts disabled
+inline void readyInit();
+inline void readyMoveDue(const unsigned long currentMillis);
+inline void readyInsertAfter(Task *previousTask, Task *task, const byte priority);
+inline Task *readyRemoveFirst();
+inline bool readyContainsEqual(Task *task) const;
+inline void readyRemoveEqual(Task *task);
+inline void readyRemove(Task *task);
+static inline byte readyPriority(Task *task);
@@ -0,0 +1,259 @@
+#ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
+// -------------------------------------------------------------------------------------------------
+// Implementation (usuallly in CPP file)
+// -------------------------------------------------------------------------------------------------
+
+#ifdef TASK_PRIORITIES
+void Scheduler::schedule(void (*callback)(), const TaskPriority priority) {
+  Task *newTask = new CallbackTask(callback, getMillis());
+  insertTaskWithPriority(newTask, priority, false);
+}
+
+void Scheduler::schedule(Runnable *runnable, const TaskPriority priority) {
+  Task *newTask = new RunnableTask(runnable, getMillis());
+  insertTaskWithPriority(newTask, priority, false);
+}
+
+void Scheduler::scheduleOnce(void (*callback)(), const TaskPriority priority) {
+  Task *newTask = new CallbackTask(callback, getMillis());
+  insertTaskWithPriority(newTask, priority, true);
+}
+
+void Scheduler::scheduleOnce(Runnable *runnable, const TaskPriority priority) {
+  Task *newTask = new RunnableTask(runnable, getMillis());
+  insertTaskWithPriority(newTask, priority, true);
+}
+
+void Scheduler::scheduleDelayed(void (*callback)(), unsigned long delayMillis, const TaskPriority priority) {
+  Task *newTask = new CallbackTask(callback, getMillis() + delayMillis);
+  insertTaskWithPriority(newTask, priority, false);
+}
+
+void Scheduler::scheduleDelayed(Runnable *runnable, unsigned long delayMillis, const TaskPriority priority) {
+  Task *newTask = new RunnableTask(runnable, getMillis() + delayMillis);
+  insertTaskWithPriority(newTask, priority, false);
+}
+
+void Scheduler::scheduleAt(void (*callback)(), unsigned long uptimeMillis, const TaskPriority priority) {
+  Task *newTask = new CallbackTask(callback, uptimeMillis);
+  insertTaskWithPriority(newTask, priority, false);
+}
+
+void Scheduler::scheduleAt(Runnable *runnable, unsigned long uptimeMillis, const TaskPriority priority) {
+  Task *newTask = new RunnableTask(runnable, uptimeMillis);
+  insertTaskWithPriority(newTask, priority, false);
+}
+
+void Scheduler::insertTaskWithPriority(Task *newTask, const TaskPriority priority, const bool removeExisting) {
+  if (newTask == NULL) {
+    // out of memory
+    return;
+  }
+  newTask->priority = priority;
+  if (removeExisting) {
+    insertTaskAndRemoveExisting(newTask);
+  } else {
+    insertTask(newTask);
+  }
+}
+#endif
+
+#ifdef TASK_DEADLINES
+void Scheduler::scheduleWithDeadline(void (*callback)(), unsigned long delayMillis, unsigned long deadlineMillis) {
+  Task *newTask = new CallbackTask(callback, getMillis() + delayMillis);
+  insertTaskWithDeadline(newTask, deadlineMillis);
+}
+
+void Scheduler::scheduleWithDeadline(Runnable *runnable, unsigned long delayMillis, unsigned long deadlineMillis) {
+  Task *newTask = new RunnableTask(runnable, getMillis() + delayMillis);
+  insertTaskWithDeadline(newTask, deadlineMillis);
+}
+
+unsigned long Scheduler::getDeadlineMissCount() const {
+  noInterrupts();
+  const unsigned long count = deadlineMissCount;
+  interrupts();
+  return count;
+}
+
+unsigned long Scheduler::getMaxDeadlineMissMillis() const {
+  noInterrupts();
+  const unsigned long millis = maxDeadlineMissMillis;
+  interrupts();
+  return millis;
+}
+
+void Scheduler::insertTaskWithDeadline(Task *newTask, const unsigned long deadlineMillis) {
+  if (newTask == NULL) {
+    // out of memory
+    return;
+  }
+  newTask->deadlineMillis = deadlineMillis;
+  insertTask(newTask);
+}
+
+// Counts and reports the task if it finished after its deadline. Called on the main thread after the task ran,
+// also with ESP32_DUAL_CORE because tasks with a deadline cannot be scheduled on the second core.
+void Scheduler::checkDeadline(Task *task) {
+  const unsigned long deadline = task->scheduledUptimeMillis + task->deadlineMillis;
+  const unsigned long finishedMillis = getMillis();
+  if (!timeBefore(deadline, finishedMillis)) {
+    return;
+  }
+  const unsigned long lateMillis = timeDifference(finishedMillis, deadline);
+  noInterrupts();
+  deadlineMissCount++;
+  if (lateMillis > maxDeadlineMissMillis) {
+    maxDeadlineMissMillis = lateMillis;
+  }
+  interrupts();
+  if (deadlineMissCallback != NULL) {
+    if (task->isCallbackTask) {
+      deadlineMissCallback(((CallbackTask*)task)->callback, NULL, lateMillis);
+    } else {
+      deadlineMissCallback(NULL, ((RunnableTask*)task)->runnable, lateMillis);
+    }
+  }
+}
+#endif
+
+void Scheduler::readyInit() {
+  for (byte i = 0; i < TASK_PRIORITY_COUNT; i++) {
+    readyFirst[i] = NULL;
+    readyLast[i] = NULL;
+  }
+  readyBitmap = 0;
+#ifdef TASK_DEADLINES
+  deadlineMissCallback = NULL;
+  deadlineMissCount = 0;
+  maxDeadlineMissMillis = 0;
+#endif
+}
+
+// Moves all due tasks from the run queue to the list of their priority. Tasks scheduled with
+// scheduleAtFrontOfQueue() are moved before the tasks that are ready already, tasks with a
+// deadline after the ready tasks with an earlier or the same deadline.
+void Scheduler::readyMoveDue(const unsigned long currentMillis) {
+  // the last task moved to the front of each list in this call
+  Task *frontLast[TASK_PRIORITY_COUNT] = {NULL};
+  Task *task;
+  while ((task = queueRemoveFirstIfDue(currentMillis)) != NULL) {
+    const byte priority = readyPriority(task);
+    task->ready = true;
+    // the task is inserted after previousTask, at the start if it is NULL
+    Task *previousTask;
+    if (task->atFrontOfQueue) {
+      // keep the order of the run queue within the tasks moved to the front
+      previousTask = frontLast[priority];
+      frontLast[priority] = task;
+    } else {
+      previousTask = readyLast[priority];
+#ifdef TASK_DEADLINES
+      if (task->deadlineMillis != 0) {
+        const unsigned long deadline = task->scheduledUptimeMillis + task->deadlineMillis;
+        previousTask = NULL;
+        Task *nextTask = readyFirst[priority];
+        while (nextTask != NULL
+               && (nextTask->atFrontOfQueue
+                   || (nextTask->deadlineMillis != 0
+                       && !timeBefore(deadline, nextTask->scheduledUptimeMillis + nextTask->deadlineMillis)))) {
+          previousTask = nextTask;
+          nextTask = nextTask->next;
+        }
+      }
+#endif
+    }
+    readyInsertAfter(previousTask, task, priority);
+  }
+}
+
+void Scheduler::readyInsertAfter(Task *previousTask, Task *task, const byte priority) {
+  if (previousTask == NULL) {
+    task->next = readyFirst[priority];
+    readyFirst[priority] = task;
+  } else {
+    task->next = previousTask->next;
+    previousTask->next = task;
+  }
+  if (task->next == NULL) {
+    readyLast[priority] = task;
+  }
+  readyBitmap |= 1 << priority;
+}
+
+// Removes and returns the first task of the highest priority that is ready, NULL if none is.
+Scheduler::Task *Scheduler::readyRemoveFirst() {
+  if (readyBitmap == 0) {
+    return NULL;
+  }
+  // highest bit set, TASK_PRIORITY_COUNT is 4 or 1
+  const byte priority = readyBitmap >= 8 ? 3 : readyBitmap >= 4 ? 2 : readyBitmap >= 2 ? 1 : 0;
+  Task *task = readyFirst[priority];
+  readyFirst[priority] = task->next;
+  if (task->next == NULL) {
+    readyLast[priority] = NULL;
+    readyBitmap &= ~(1 << priority);
+  }
+  task->ready = false;
+  return task;
+}
+
+bool Scheduler::readyContainsEqual(Task *task) const {
+  for (byte priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+    for (Task *readyTask = readyFirst[priority]; readyTask != NULL; readyTask = readyTask->next) {
+      if (readyTask->equalCallback(task)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void Scheduler::readyRemoveEqual(Task *task) {
+  for (byte priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+    Task *readyTask = readyFirst[priority];
+    while (readyTask != NULL) {
+      Task *nextTask = readyTask->next;
+      if (readyTask->equalCallback(task)) {
+        readyRemove(readyTask);
+        delete readyTask;
+      }
+      readyTask = nextTask;
+    }
+  }
+}
+
+// Removes the task from its ready list without deleting it. Takes O(n) of the tasks with the
+// same priority as the lists are singly linked.
+void Scheduler::readyRemove(Task *task) {
+  const byte priority = readyPriority(task);
+  Task *previousTask = NULL;
+  if (readyFirst[priority] == task) {
+    readyFirst[priority] = task->next;
+  } else {
+    previousTask = readyFirst[priority];
+    while (previousTask->next != task) {
+      previousTask = previousTask->next;
+    }
+    previousTask->next = task->next;
+  }
+  if (readyLast[priority] == task) {
+    readyLast[priority] = previousTask;
+  }
+  if (readyFirst[priority] == NULL) {
+    readyBitmap &= ~(1 << priority);
+  }
+  task->ready = false;
+}
+
+#ifdef TASK_PRIORITIES
+byte Scheduler::readyPriority(Task *task) {
+  return task->priority;
+}
+#else
+byte Scheduler::readyPriority(Task *) {
+  return 0;
+}
+#endif
+
+#endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
@@ -0,0 +1,25 @@
+// -------------------------------------------------------------------------------------------------
+// Definition of the submission ring used by scheduleFromInterrupt(), included inside of class Scheduler
+// -------------------------------------------------------------------------------------------------
+// Interrupts write at submissionRingHead, execute() reads at submissionRingTail.
+// One entry is kept free to distinguish a full from an empty ring.
+
+private:
+struct SubmissionRingEntry {
+  void (*callback)();
+  Runnable *runnable;
+#ifdef ESP32
+  // set when the entry is written as entries are reserved before they are written
+  bool ready;
+#endif
+};
+SubmissionRingEntry submissionRing[SUBMISSION_RING_SIZE];
+volatile byte submissionRingHead;
+volatile byte submissionRingTail;
+volatile byte submissionRingHighWaterMark;
+volatile unsigned int submissionRingDropCount;
+
+inline void submissionRingInit();
+inline bool submissionRingIsEmpty() const;
+inline bool submissionRingAdd(void (*callback)(), Runnable *runnable);
+inline void submissionRingDrain();
@@ -0,0 +1,138 @@
+#ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
+// -------------------------------------------------------------------------------------------------
+// Implementation (usuallly in CPP file)
+// -------------------------------------------------------------------------------------------------
+
+// prevents the compiler from moving memory accesses across it
+#define SUBMISSION_RING_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+void Scheduler::submissionRingInit() {
+  submissionRingHead = 0;
+  submissionRingTail = 0;
+  submissionRingHighWaterMark = 0;
+  submissionRingDropCount = 0;
+#ifdef ESP32
+  for (byte i = 0; i < SUBMISSION_RING_SIZE; i++) {
+    submissionRing[i].ready = false;
+  }
+#endif
+}
+
+bool Scheduler::scheduleFromInterrupt(void (*callback)()) {
+  return submissionRingAdd(callback, NULL);
+}
+
+bool Scheduler::scheduleFromInterrupt(Runnable *runnable) {
+  return submissionRingAdd(NULL, runnable);
+}
+
+byte Scheduler::getSubmissionRingHighWaterMark() const {
+  return submissionRingHighWaterMark;
+}
+
+unsigned int Scheduler::getSubmissionRingDropCount() const {
+  noInterrupts();
+  const unsigned int count = submissionRingDropCount;
+  interrupts();
+  return count;
+}
+
+bool Scheduler::submissionRingIsEmpty() const {
+  return submissionRingHead == submissionRingTail;
+}
+
+bool Scheduler::submissionRingAdd(void (*callback)(), Runnable *runnable) {
+#ifdef ESP32
+  // interrupts may nest and run on both cores, so the entry is reserved atomically
+  byte head = __atomic_load_n(&submissionRingHead, __ATOMIC_RELAXED);
+  byte nextHead;
+  do {
+    nextHead = head + 1 == SUBMISSION_RING_SIZE ? 0 : head + 1;
+    if (nextHead == __atomic_load_n(&submissionRingTail, __ATOMIC_ACQUIRE)) {
+      __atomic_fetch_add(&submissionRingDropCount, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+  } while (!__atomic_compare_exchange_n(&submissionRingHead, &head, nextHead, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+#else
+#ifdef __AVR__
+  // An interrupt that calls an other schedule method enables interrupts in getMillis(), so an other
+  // interrupt may call this method in between. Reserve and write the entry with interrupts disabled
+  // and restore the interrupt flag instead of enabling interrupts.
+  const uint8_t sreg = SREG;
+  cli();
+#endif
+  // otherwise interrupts do not nest, so there is only one writer at a time
+  const byte head = submissionRingHead;
+  const byte nextHead = head + 1 == SUBMISSION_RING_SIZE ? 0 : head + 1;
+  if (nextHead == submissionRingTail) {
+    submissionRingDropCount++;
+#ifdef __AVR__
+    SREG = sreg;
+#endif
+    return false;
+  }
+#endif
+  SubmissionRingEntry *entry = &submissionRing[head];
+  entry->callback = callback;
+  entry->runnable = runnable;
+#ifdef ESP32
+  __atomic_store_n(&entry->ready, true, __ATOMIC_RELEASE);
+#else
+  // the entry must be written before it is published
+  SUBMISSION_RING_BARRIER();
+  submissionRingHead = nextHead;
+#ifdef __AVR__
+  SREG = sreg;
+#endif
+#endif
+
+  const byte tail = submissionRingTail;
+  const byte used = nextHead >= tail ? nextHead - tail : nextHead + SUBMISSION_RING_SIZE - tail;
+  if (used > submissionRingHighWaterMark) {
+    submissionRingHighWaterMark = used;
+  }
+#if defined(ARDUINO) && !defined(ESP32) && !defined(ESP8266)
+  // in case the main thread decided to sleep before this interrupt,
+  // it shall not sleep but take the new entry first
+  sleep_disable();
+#endif
+  return true;
+}
+
+// Moves all entries to the run queue. Only called by execute().
+void Scheduler::submissionRingDrain() {
+  byte tail = submissionRingTail;
+  while (tail != submissionRingHead) {
+    SubmissionRingEntry *entry = &submissionRing[tail];
+#ifdef ESP32
+    if (!__atomic_load_n(&entry->ready, __ATOMIC_ACQUIRE)) {
+      // reserved but not written yet, take it next time
+      break;
+    }
+    entry->ready = false;
+#else
+    SUBMISSION_RING_BARRIER();
+#endif
+    void (*callback)() = entry->callback;
+    Runnable *runnable = entry->runnable;
+    tail = tail + 1 == SUBMISSION_RING_SIZE ? 0 : tail + 1;
+    // free the entry before the task is scheduled as that may take longer
+    SUBMISSION_RING_BARRIER();
+    submissionRingTail = tail;
+
+#ifdef TRACE_BUFFER_SIZE
+    traceFromInterrupt = true;
+#endif
+    if (callback != NULL) {
+      schedule(callback);
+    } else {
+      schedule(runnable);
+    }
+#ifdef TRACE_BUFFER_SIZE
+    traceFromInterrupt = false;
+#endif
+  }
+}
+
+#endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
@@ -0,0 +1,54 @@
+// -------------------------------------------------------------------------------------------------
+// Definition of the hierarchical timing wheel run queue, included inside of class Scheduler
+// -------------------------------------------------------------------------------------------------
+// Level 0 has a slot per millisecond, every further level a slot per 32 slots of the level below.
+// A task is stored in the lowest level in which its time and wheelTime share all higher bits.
+// When wheelTime advances, the slots that were passed are moved to lower levels or the due list.
+// The top level only uses 2 bits of the time and is handled circularly so that the wheel
+// stays correct when the time wraps.
+
+// Constants
+// =========
+#define WHEEL_BITS 5
+#define WHEEL_SLOTS 32
+#define WHEEL_MASK 0x1F
+#define WHEEL_LEVELS 7
+#define WHEEL_DUE_SLOT 255
+
+private:
+/**
+  circular doubly linked lists of the tasks per slot
+*/
+Task *wheelSlots[WHEEL_LEVELS][WHEEL_SLOTS];
+/**
+  bit set per used slot
+*/
+uint32_t wheelOccupied[WHEEL_LEVELS];
+/**
+  tasks with a time up to wheelTime, ordered like the sorted list
+*/
+Task *wheelDue;
+unsigned long wheelTime;
+unsigned long wheelSequence;
+
+inline void queueInit();
+inline bool queueIsEmpty() const;
+inline Task *queuePeek() const;
+inline Task *queueRemoveFirstIfDue(const unsigned long currentMillis);
+inline bool queueInsert(Task *newTask);
+inline bool queueInsertAtFront(Task *newTask);
+inline bool queueInsertAfter(Task *newTask, Task *previousTask);
+inline bool queueContainsEqual(Task *task) const;
+inline void queueRemoveEqual(Task *task);
+inline void queueRemove(Task *task);
+template <class Visitor> void queueVisitUntil(Visitor &visitor);
+
+inline void wheelAdvance(const unsigned long currentMillis);
+inline void wheelPlace(Task *task);
+inline void wheelInsertDue(Task *task);
+inline void wheelRemove(Task *task);
+inline Task **wheelList(const byte wheelSlot);
+inline byte wheelFirstSlot(const byte level, const uint32_t occupied) const;
+static inline byte wheelLowestSlot(uint32_t bits);
+static inline void wheelListAppend(Task **head, Task *task);
+static inline void wheelListRemove(Task **head, Task *task);
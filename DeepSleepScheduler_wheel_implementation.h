@@ -0,0 +1,349 @@
+#ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
+// -------------------------------------------------------------------------------------------------
+// Implementation (usuallly in CPP file)
+// -------------------------------------------------------------------------------------------------
+
+void Scheduler::queueInit() {
+  for (byte level = 0; level < WHEEL_LEVELS; level++) {
+    for (byte slot = 0; slot < WHEEL_SLOTS; slot++) {
+      wheelSlots[level][slot] = NULL;
+    }
+    wheelOccupied[level] = 0;
+  }
+  wheelDue = NULL;
+  wheelTime = 0;
+  wheelSequence = 0;
+}
+
+bool Scheduler::queueIsEmpty() const {
+  if (wheelDue != NULL) {
+    return false;
+  }
+  for (byte level = 0; level < WHEEL_LEVELS; level++) {
+    if (wheelOccupied[level] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Scheduler::Task *Scheduler::queuePeek() const {
+  if (wheelDue != NULL) {
+    return wheelDue;
+  }
+  // all tasks of a lower level are before the ones of higher levels
+  for (byte level = 0; level < WHEEL_LEVELS; level++) {
+    if (wheelOccupied[level] != 0) {
+      Task *head = wheelSlots[level][wheelFirstSlot(level, wheelOccupied[level])];
+      if (level == 0) {
+        // all tasks in a slot of level 0 have the same time
+        return head;
+      }
+      Task *firstTask = head;
+      for (Task *task = head->next; task != head; task = task->next) {
+        if (timeBefore(task->scheduledUptimeMillis, firstTask->scheduledUptimeMillis)) {
+          firstTask = task;
+        }
+      }
+      return firstTask;
+    }
+  }
+  return NULL;
+}
+
+Scheduler::Task *Scheduler::queueRemoveFirstIfDue(const unsigned long currentMillis) {
+  wheelAdvance(currentMillis);
+  // all tasks in the due list have a time up to wheelTime
+  Task *task = wheelDue;
+  if (task != NULL) {
+    wheelListRemove(&wheelDue, task);
+  }
+  return task;
+}
+
+bool Scheduler::queueInsert(Task *newTask) {
+  newTask->sequence = wheelSequence++;
+  newTask->atFrontOfQueue = false;
+  wheelPlace(newTask);
+  return true;
+}
+
+bool Scheduler::queueInsertAtFront(Task *newTask) {
+  newTask->sequence = wheelSequence++;
+  newTask->atFrontOfQueue = true;
+  newTask->wheelSlot = WHEEL_DUE_SLOT;
+  // appended as tail of the circular list and then made the head
+  wheelListAppend(&wheelDue, newTask);
+  wheelDue = newTask;
+  return true;
+}
+
+// The slot in the wheel does not depend on other tasks, so previousTask is not needed.
+bool Scheduler::queueInsertAfter(Task *newTask, Task *) {
+  return queueInsert(newTask);
+}
+
+bool Scheduler::queueContainsEqual(Task *task) const {
+  for (byte list = 0; list <= WHEEL_LEVELS; list++) {
+    uint32_t occupied;
+    if (list == WHEEL_LEVELS) {
+      occupied = wheelDue != NULL ? 1 : 0;
+    } else {
+      occupied = wheelOccupied[list];
+    }
+    byte slot = 0;
+    while (occupied != 0) {
+      if (occupied & 1) {
+        Task *head = list == WHEEL_LEVELS ? wheelDue : wheelSlots[list][slot];
+        Task *currentTask = head;
+        do {
+          if (currentTask->equalCallback(task)) {
+            return true;
+          }
+          currentTask = currentTask->next;
+        } while (currentTask != head);
+      }
+      occupied >>= 1;
+      slot++;
+    }
+  }
+  return false;
+}
+
+void Scheduler::queueRemoveEqual(Task *task) {
+  for (byte list = 0; list <= WHEEL_LEVELS; list++) {
+    uint32_t occupied;
+    if (list == WHEEL_LEVELS) {
+      occupied = wheelDue != NULL ? 1 : 0;
+    } else {
+      occupied = wheelOccupied[list];
+    }
+    byte slot = 0;
+    while (occupied != 0) {
+      if (occupied & 1) {
+        Task **head = list == WHEEL_LEVELS ? &wheelDue : &wheelSlots[list][slot];
+        Task *lastTask = (*head)->previous;
+        Task *currentTask = *head;
+        while (true) {
+          Task *nextTask = currentTask->next;
+          const bool isLast = currentTask == lastTask;
+          if (currentTask->equalCallback(task)) {
+            wheelRemove(currentTask);
+            delete currentTask;
+          }
+          if (isLast || *head == NULL) {
+            break;
+          }
+          currentTask = nextTask;
+        }
+      }
+      occupied >>= 1;
+      slot++;
+    }
+  }
+}
+
+void Scheduler::queueRemove(Task *task) {
+  wheelRemove(task);
+}
+
+template <class Visitor> void Scheduler::queueVisitUntil(Visitor &visitor) {
+  if (wheelDue != NULL) {
+    Task *task = wheelDue;
+    do {
+      visitor.visit(task);
+      task = task->next;
+    } while (task != wheelDue);
+  }
+  // slots are visited in the order of time
+  for (byte level = 0; level < WHEEL_LEVELS; level++) {
+    const byte shift = level * WHEEL_BITS;
+    const unsigned long higherBits = wheelTime >> shift >> WHEEL_BITS << WHEEL_BITS << shift;
+    uint32_t occupied = wheelOccupied[level];
+    while (occupied != 0) {
+      const byte slot = wheelFirstSlot(level, occupied);
+      occupied &= ~((uint32_t) 1 << slot);
+      if (timeBefore(visitor.limit, higherBits | ((unsigned long) slot << shift))) {
+        // all tasks of this and the following slots are after the limit
+        return;
+      }
+      Task *head = wheelSlots[level][slot];
+      Task *task = head;
+      do {
+        if (!timeBefore(visitor.limit, task->scheduledUptimeMillis)) {
+          visitor.visit(task);
+        }
+        task = task->next;
+      } while (task != head);
+    }
+  }
+}
+
+// Moves the tasks of all slots passed between wheelTime and currentMillis to
+// the lower levels or the due list.
+void Scheduler::wheelAdvance(const unsigned long currentMillis) {
+  if (!timeBefore(wheelTime, currentMillis)) {
+    return;
+  }
+  Task *cascadeFirst = NULL;
+  Task *cascadeLast = NULL;
+  for (byte level = 0; level < WHEEL_LEVELS; level++) {
+    const byte shift = level * WHEEL_BITS;
+    const byte oldIndex = (wheelTime >> shift) & WHEEL_MASK;
+    const byte newIndex = (currentMillis >> shift) & WHEEL_MASK;
+    uint32_t passed;
+    if ((wheelTime >> shift >> WHEEL_BITS) != (currentMillis >> shift >> WHEEL_BITS)) {
+      // a higher level changed, all tasks of this level are passed
+      passed = 0xFFFFFFFF;
+    } else if (newIndex > oldIndex) {
+      // slots after oldIndex up to and including newIndex
+      passed = (((uint32_t) 2 << newIndex) - 1) & ~(((uint32_t) 2 << oldIndex) - 1);
+    } else if (newIndex < oldIndex) {
+      // only possible on the top level when the time wraps
+      passed = (((uint32_t) 2 << newIndex) - 1) | ~(((uint32_t) 2 << oldIndex) - 1);
+    } else {
+      continue;
+    }
+    passed &= wheelOccupied[level];
+    wheelOccupied[level] &= ~passed;
+    while (passed != 0) {
+      const byte slot = wheelLowestSlot(passed);
+      passed &= ~((uint32_t) 1 << slot);
+      // detach the circular list and append it to the cascade list
+      Task *head = wheelSlots[level][slot];
+      wheelSlots[level][slot] = NULL;
+      head->previous->next = NULL;
+      if (cascadeLast == NULL) {
+        cascadeFirst = head;
+      } else {
+        cascadeLast->next = head;
+      }
+      cascadeLast = head->previous;
+    }
+  }
+  wheelTime = currentMillis;
+
+  Task *task = cascadeFirst;
+  while (task != NULL) {
+    Task *nextTask = task->next;
+    wheelPlace(task);
+    task = nextTask;
+  }
+}
+
+void Scheduler::wheelPlace(Task *task) {
+  // the wheel uses 32 bits of the time, also where unsigned long has 64 bits
+  const uint32_t time = task->scheduledUptimeMillis;
+  if (!timeBefore(wheelTime, time)) {
+    wheelInsertDue(task);
+    return;
+  }
+  // the level is defined by the highest bit group that differs from wheelTime
+  uint32_t difference = (time ^ (uint32_t) wheelTime) >> WHEEL_BITS;
+  byte level = 0;
+  while (difference != 0) {
+    difference >>= WHEEL_BITS;
+    level++;
+  }
+  const byte slot = (time >> (level * WHEEL_BITS)) & WHEEL_MASK;
+  task->wheelSlot = level * WHEEL_SLOTS + slot;
+  wheelListAppend(&wheelSlots[level][slot], task);
+  wheelOccupied[level] |= (uint32_t) 1 << slot;
+}
+
+// Inserts the task in the due list ordered by time and sequence but after tasks at front of queue.
+void Scheduler::wheelInsertDue(Task *task) {
+  task->wheelSlot = WHEEL_DUE_SLOT;
+  if (wheelDue == NULL) {
+    wheelListAppend(&wheelDue, task);
+    return;
+  }
+  // usually the task is inserted at the end, so search from the last one backwards
+  Task *previousTask = wheelDue->previous;
+  while (!previousTask->atFrontOfQueue
+         && (timeBefore(task->scheduledUptimeMillis, previousTask->scheduledUptimeMillis)
+             || (previousTask->scheduledUptimeMillis == task->scheduledUptimeMillis
+                 && (long)(previousTask->sequence - task->sequence) > 0))) {
+    if (previousTask == wheelDue) {
+      // insert as new head
+      wheelListAppend(&wheelDue, task);
+      wheelDue = task;
+      return;
+    }
+    previousTask = previousTask->previous;
+  }
+  // insert after previousTask
+  task->previous = previousTask;
+  task->next = previousTask->next;
+  previousTask->next->previous = task;
+  previousTask->next = task;
+}
+
+void Scheduler::wheelRemove(Task *task) {
+  Task **head = wheelList(task->wheelSlot);
+  wheelListRemove(head, task);
+  if (*head == NULL && task->wheelSlot != WHEEL_DUE_SLOT) {
+    wheelOccupied[task->wheelSlot / WHEEL_SLOTS] &= ~((uint32_t) 1 << (task->wheelSlot % WHEEL_SLOTS));
+  }
+}
+
+Scheduler::Task **Scheduler::wheelList(const byte wheelSlot) {
+  if (wheelSlot == WHEEL_DUE_SLOT) {
+    return &wheelDue;
+  }
+  return &wheelSlots[wheelSlot / WHEEL_SLOTS][wheelSlot % WHEEL_SLOTS];
+}
+
+// Returns the slot of the given ones of a level that comes first in time. Only on the top level,
+// slots before the current one can be later in time because the time wrapped.
+byte Scheduler::wheelFirstSlot(const byte level, const uint32_t occupied) const {
+  if (level == WHEEL_LEVELS - 1) {
+    const byte index = (wheelTime >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    const uint32_t afterIndex = occupied & ~(((uint32_t) 2 << index) - 1);
+    if (afterIndex != 0) {
+      return wheelLowestSlot(afterIndex);
+    }
+  }
+  return wheelLowestSlot(occupied);
+}
+
+byte Scheduler::wheelLowestSlot(uint32_t bits) {
+  byte slot = 0;
+  while ((bits & 0xFF) == 0) {
+    bits >>= 8;
+    slot += 8;
+  }
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    slot++;
+  }
+  return slot;
+}
+
+void Scheduler::wheelListAppend(Task **head, Task *task) {
+  if (*head == NULL) {
+    task->next = task;
+    task->previous = task;
+    *head = task;
+  } else {
+    Task *last = (*head)->previous;
+    task->previous = last;
+    task->next = *head;
+    last->next = task;
+    (*head)->previous = task;
+  }
+}
+
+void Scheduler::wheelListRemove(Task **head, Task *task) {
+  if (task->next == task) {
+    *head = NULL;
+  } else {
+    task->previous->next = task->next;
+    task->next->previous = task->previous;
+    if (*head == task) {
+      *head = task->next;
+    }
+  }
+}
+
+#endif // #ifndef LIBCALL_DEEP_SLEEP_SCHEDULER
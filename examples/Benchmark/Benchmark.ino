@@ -0,0 +1,297 @@
+// Measures the run time of the scheduler methods and the longest time they keep
+// interrupts disabled for different numbers of scheduled tasks. Prints one CSV
+// line per method and queue depth in CPU cycles (Timer1 on AVR, ESP.getCycleCount()
+// on ESP) or in nanoseconds on the host simulation. Compare the output before and
+// after a change to find regressions.
+// On the host, compile it e.g. with
+// g++ -x c++ -I<path to DeepSleepScheduler> Benchmark.ino -o benchmark
+//
+// Enable the options to compare, e.g.
+// #define TASK_QUEUE_HEAP
+// #define TASK_QUEUE_HEAP_SIZE 600
+// #define TASK_QUEUE_TIMING_WHEEL
+// #define TASK_CALLBACK_INDEX_SIZE 8
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <DeepSleepScheduler_host_includes.h>
+#include <time.h>
+#endif
+
+#ifdef __AVR__
+#define UNIT "cycles"
+const unsigned int DEPTHS[] = {0, 8, 32};
+volatile unsigned int timer1Overflows = 0;
+
+ISR (TIMER1_OVF_vect) {
+  timer1Overflows++;
+}
+
+// Timer1 counts the CPU cycles, its overflows extend it to 32 bits
+unsigned long readCycles() {
+  const uint8_t sreg = SREG;
+  cli();
+  unsigned int overflows = timer1Overflows;
+  const unsigned int counter = TCNT1;
+  if ((TIFR1 & (1 << TOV1)) && counter < 0x8000) {
+    // the overflow interrupt did not run yet
+    overflows++;
+  }
+  SREG = sreg;
+  return ((unsigned long) overflows << 16) | counter;
+}
+
+void startCycleCounter() {
+  TCCR1A = 0;
+  TCCR1B = (1 << CS10); // no prescaler
+  TIMSK1 = (1 << TOIE1);
+}
+#elif defined(ESP32) || defined(ESP8266)
+#define UNIT "cycles"
+const unsigned int DEPTHS[] = {0, 8, 32, 128, 512};
+
+unsigned long readCycles() {
+  return ESP.getCycleCount();
+}
+
+void startCycleCounter() {}
+#else
+#define UNIT "ns"
+const unsigned int DEPTHS[] = {0, 8, 32, 128, 512};
+
+unsigned long readCycles() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000000000UL + time.tv_nsec;
+}
+
+void startCycleCounter() {}
+#endif
+
+#if defined(__AVR__) || !defined(ARDUINO)
+// Measure the time between noInterrupts() and interrupts() of the library.
+// The library only locks once at a time, nested calls are ignored.
+#define MEASURE_INTERRUPT_LOCK
+bool lockMeasuring = false;
+bool locked = false;
+unsigned long lockStartCycles;
+unsigned long maxLockCycles;
+
+void lockBegin() {
+#ifdef __AVR__
+  cli();
+#else
+  (noInterrupts)();
+#endif
+  if (!locked) {
+    locked = true;
+    lockStartCycles = readCycles();
+  }
+}
+
+void lockEnd() {
+  if (locked) {
+    const unsigned long cycles = readCycles() - lockStartCycles;
+    if (lockMeasuring && cycles > maxLockCycles) {
+      maxLockCycles = cycles;
+    }
+    locked = false;
+  }
+#ifdef __AVR__
+  sei();
+#else
+  (interrupts)();
+#endif
+}
+
+#undef noInterrupts
+#undef interrupts
+#define noInterrupts() lockBegin()
+#define interrupts() lockEnd()
+#endif
+
+#include <DeepSleepScheduler.h>
+
+#define REPEAT 16
+// the tasks filling the queue run after one hour, i.e. not during the benchmark
+#define FILLER_DELAY 3600000UL
+
+byte depthIndex = 0;
+unsigned long overheadCycles = 0;
+unsigned long lockOverheadCycles = 0;
+volatile bool scheduled;
+
+void filler() {}
+void target() {}
+
+void scheduleTarget() {
+  scheduler.schedule(target);
+}
+void scheduleTargetDelayed() {
+  // in the middle of the fillers
+  scheduler.scheduleDelayed(target, FILLER_DELAY + DEPTHS[depthIndex] * 5);
+}
+void scheduleTargetLast() {
+  scheduler.scheduleDelayed(target, 2 * FILLER_DELAY);
+}
+void scheduleTargetOnce() {
+  scheduler.scheduleOnce(target);
+}
+void isTargetScheduled() {
+  scheduled = scheduler.isScheduled(target);
+}
+void removeTarget() {
+  scheduler.removeCallbacks(target);
+}
+void empty() {}
+
+void printResult(const char *name, const unsigned long totalCycles, const unsigned long lockCycles) {
+  const unsigned long average = totalCycles / REPEAT;
+  Serial.print(name);
+  Serial.print(',');
+  Serial.print(DEPTHS[depthIndex]);
+  Serial.print(',');
+  Serial.print(average > overheadCycles ? average - overheadCycles : 0);
+  Serial.print(',');
+#ifdef MEASURE_INTERRUPT_LOCK
+  Serial.println(lockCycles > lockOverheadCycles ? lockCycles - lockOverheadCycles : 0);
+#else
+  Serial.println('-');
+#endif
+}
+
+/**
+  Runs the operation REPEAT times and returns the total cycles. prepare and cleanup are not measured.
+*/
+unsigned long measure(void (*prepare)(), void (*operation)(), void (*cleanup)()) {
+  unsigned long totalCycles = 0;
+#ifdef MEASURE_INTERRUPT_LOCK
+  maxLockCycles = 0;
+#endif
+  for (byte i = 0; i < REPEAT; i++) {
+    if (prepare != NULL) {
+      prepare();
+    }
+#ifdef MEASURE_INTERRUPT_LOCK
+    lockMeasuring = true;
+#endif
+    const unsigned long startCycles = readCycles();
+    operation();
+    totalCycles += readCycles() - startCycles;
+#ifdef MEASURE_INTERRUPT_LOCK
+    lockMeasuring = false;
+#endif
+    if (cleanup != NULL) {
+      cleanup();
+    }
+  }
+  return totalCycles;
+}
+
+void measureAndPrint(const char *name, void (*prepare)(), void (*operation)(), void (*cleanup)()) {
+  const unsigned long totalCycles = measure(prepare, operation, cleanup);
+#ifdef MEASURE_INTERRUPT_LOCK
+  printResult(name, totalCycles, maxLockCycles);
+#else
+  printResult(name, totalCycles, 0);
+#endif
+}
+
+void calibrate() {
+  // the overhead of the measurement itself
+  overheadCycles = measure(NULL, empty, NULL) / REPEAT;
+#ifdef MEASURE_INTERRUPT_LOCK
+  lockMeasuring = true;
+  maxLockCycles = 0;
+  noInterrupts();
+  interrupts();
+  lockMeasuring = false;
+  lockOverheadCycles = maxLockCycles;
+#endif
+}
+
+// executeNextIfTime() is measured from the end of one task to the start of the next one
+byte dispatchCount;
+unsigned long dispatchStartCycles;
+unsigned long dispatchTotalCycles;
+
+void dispatchEnd();
+void runDepth();
+
+void dispatchStart() {
+  scheduler.schedule(dispatchEnd);
+#ifdef MEASURE_INTERRUPT_LOCK
+  lockMeasuring = true;
+#endif
+  dispatchStartCycles = readCycles();
+}
+
+void dispatchEnd() {
+  dispatchTotalCycles += readCycles() - dispatchStartCycles;
+#ifdef MEASURE_INTERRUPT_LOCK
+  lockMeasuring = false;
+#endif
+  dispatchCount++;
+  if (dispatchCount < REPEAT) {
+    scheduler.schedule(dispatchStart);
+    return;
+  }
+#ifdef MEASURE_INTERRUPT_LOCK
+  printResult("executeNextIfTime", dispatchTotalCycles, maxLockCycles);
+#else
+  printResult("executeNextIfTime", dispatchTotalCycles, 0);
+#endif
+  Serial.flush();
+
+  depthIndex++;
+  scheduler.removeCallbacks(filler);
+  if (depthIndex < sizeof(DEPTHS) / sizeof(DEPTHS[0])) {
+    scheduler.schedule(runDepth);
+  } else {
+    Serial.println(F("done"));
+    Serial.flush();
+  }
+}
+
+void runDepth() {
+  for (unsigned int i = 0; i < DEPTHS[depthIndex]; i++) {
+    scheduler.scheduleDelayed(filler, FILLER_DELAY + i * 10);
+  }
+  measureAndPrint("schedule", NULL, scheduleTarget, removeTarget);
+  measureAndPrint("scheduleDelayed", NULL, scheduleTargetDelayed, removeTarget);
+  measureAndPrint("scheduleOnce", NULL, scheduleTargetOnce, removeTarget);
+  measureAndPrint("isScheduled", scheduleTargetLast, isTargetScheduled, removeTarget);
+  measureAndPrint("removeCallbacks", scheduleTargetLast, removeTarget, NULL);
+
+  dispatchCount = 0;
+  dispatchTotalCycles = 0;
+#ifdef MEASURE_INTERRUPT_LOCK
+  maxLockCycles = 0;
+#endif
+  scheduler.schedule(dispatchStart);
+}
+
+void setup() {
+  Serial.begin(115200);
+  startCycleCounter();
+  calibrate();
+  Serial.print(F("method,depth,"));
+  Serial.print(F(UNIT));
+  Serial.print(F(",maxInterruptLock "));
+  Serial.println(F(UNIT));
+  scheduler.schedule(runDepth);
+}
+
+void loop() {
+  scheduler.execute();
+}
+
+#ifndef ARDUINO
+int main() {
+  setup();
+  while (true) {
+    loop();
+  }
+}
+#endif
@@ -0,0 +1,45 @@
+// A periodic task that takes as long as its period. Every run finishes exactly
+// when the next one is due, so the next run starts late but no period is
+// skipped. The output shows the start time of every run and the number of
+// skipped periods, which stays 0. The task stops after RUN_COUNT runs.
+// On the host, compile it e.g. with
+// g++ -x c++ -I<path to DeepSleepScheduler> FixedRateOverrun.ino -o fixedRateOverrun
+#define PERIODIC_TASKS
+#include <DeepSleepScheduler.h>
+
+#define PERIOD_MILLIS 100
+#define RUN_COUNT 5
+
+unsigned int runCount = 0;
+
+void busyTask() {
+  Serial.print(F("run at "));
+  Serial.print(scheduler.getMillis());
+  Serial.print(F(" skipped "));
+  Serial.println(scheduler.getSkippedPeriodCount());
+  // takes the whole period
+  delay(PERIOD_MILLIS);
+  runCount++;
+  if (runCount == RUN_COUNT) {
+    scheduler.removeCallbacks(busyTask);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  scheduler.scheduleFixedRate(busyTask, 0, PERIOD_MILLIS);
+}
+
+void loop() {
+  // ends on the host when no task is scheduled anymore
+  scheduler.execute();
+}
+
+#ifndef ARDUINO
+int main() {
+  setup();
+  while (true) {
+    loop();
+  }
+}
+#endif
@@ -0,0 +1,42 @@
+// Powers a sensor, waits until it is ready, reads it and prints the value
+// every 10 seconds. The sequence is written in one run() method and the CPU
+// sleeps during the waits instead of calling delay().
+#define RESUMABLE_TASKS
+#include <DeepSleepScheduler.h>
+
+#define SENSOR_POWER_PIN 4
+#define SENSOR_PIN A0
+
+class MeasureRunnable: public ResumableRunnable {
+  private:
+    int value;
+  public:
+    virtual void run() {
+      RESUMABLE_BEGIN();
+      digitalWrite(SENSOR_POWER_PIN, HIGH);
+      // time for the sensor to start
+      RESUMABLE_SLEEP_FOR(200);
+      value = analogRead(SENSOR_PIN);
+      digitalWrite(SENSOR_POWER_PIN, LOW);
+
+      Serial.print(F("Value: "));
+      Serial.println(value);
+      // time for the serial output before the CPU sleeps
+      RESUMABLE_SLEEP_FOR(50);
+
+      scheduler.scheduleDelayed(this, 10000);
+      RESUMABLE_END();
+    }
+};
+
+MeasureRunnable measureRunnable;
+
+void setup() {
+  Serial.begin(115200);
+  pinMode(SENSOR_POWER_PIN, OUTPUT);
+  measureRunnable.start();
+}
+
+void loop() {
+  scheduler.execute();
+}
@@ -0,0 +1,28 @@
+// Toggles the LED every second with a periodic task. The same task is
+// reused for every run and the next run is calculated from the schedule
+// time of the previous one, so the blinking does not drift.
+#define PERIODIC_TASKS
+#include <DeepSleepScheduler.h>
+
+void toggleLed() {
+  if (digitalRead(LED_BUILTIN) == HIGH) {
+    digitalWrite(LED_BUILTIN, LOW);
+  } else {
+    digitalWrite(LED_BUILTIN, HIGH);
+  }
+}
+
+void setup() {
+#ifdef ESP32
+  // ESP_PD_DOMAIN_RTC_PERIPH needs to be kept on
+  // in order for the LED to stay on during sleep
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+#endif
+
+  pinMode(LED_BUILTIN, OUTPUT);
+  scheduler.scheduleFixedRate(toggleLed, 0, 1000);
+}
+
+void loop() {
+  scheduler.execute();
+}
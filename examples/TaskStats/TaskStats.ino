@@ -0,0 +1,57 @@
+// Prints the number of runs, the run time and the lateness of every
+// task to Serial every 10 seconds. Use it to find the tasks that keep
+// the CPU awake and to tune their schedules.
+#define TASK_STATS_SIZE 4
+#include <DeepSleepScheduler.h>
+
+void toggleLed() {
+  if (digitalRead(LED_BUILTIN) == HIGH) {
+    digitalWrite(LED_BUILTIN, LOW);
+  } else {
+    digitalWrite(LED_BUILTIN, HIGH);
+  }
+  scheduler.scheduleDelayed(toggleLed, 1000);
+}
+
+void busyTask() {
+  delay(20);
+  scheduler.scheduleDelayed(busyTask, 3000);
+}
+
+void printStats() {
+  Serial.println(F("callback runs avgMicros maxMicros avgLateMillis maxLateMillis"));
+  Scheduler::TaskStats stats;
+  for (byte i = 0; i < scheduler.getTaskStatsCount(); i++) {
+    scheduler.getTaskStats(i, stats);
+    if (stats.callback == toggleLed) {
+      Serial.print(F("toggleLed "));
+    } else if (stats.callback == busyTask) {
+      Serial.print(F("busyTask "));
+    } else {
+      Serial.print(F("printStats "));
+    }
+    Serial.print(stats.runCount);
+    Serial.print(' ');
+    Serial.print(stats.totalRunMicros / stats.runCount);
+    Serial.print(' ');
+    Serial.print(stats.maxRunMicros);
+    Serial.print(' ');
+    Serial.print(stats.totalLatenessMillis / stats.runCount);
+    Serial.print(' ');
+    Serial.println(stats.maxLatenessMillis);
+  }
+  Serial.flush();
+  scheduler.scheduleDelayed(printStats, 10000);
+}
+
+void setup() {
+  Serial.begin(115200);
+  pinMode(LED_BUILTIN, OUTPUT);
+  scheduler.schedule(toggleLed);
+  scheduler.schedule(busyTask);
+  scheduler.scheduleDelayed(printStats, 10000);
+}
+
+void loop() {
+  scheduler.execute();
+}
@@ -0,0 +1,31 @@
+// Records the scheduler events in a trace buffer and prints them to Serial
+// every 30 seconds. Decode the output on the computer with
+// python3 extras/trace_decoder.py serial.log
+#define TRACE_BUFFER_SIZE 64
+#include <DeepSleepScheduler.h>
+
+void toggleLed() {
+  if (digitalRead(LED_BUILTIN) == HIGH) {
+    digitalWrite(LED_BUILTIN, LOW);
+  } else {
+    digitalWrite(LED_BUILTIN, HIGH);
+  }
+  scheduler.scheduleDelayed(toggleLed, 2000);
+}
+
+void printTrace() {
+  scheduler.dumpTrace(Serial);
+  Serial.flush();
+  scheduler.scheduleDelayed(printTrace, 30000);
+}
+
+void setup() {
+  Serial.begin(115200);
+  pinMode(LED_BUILTIN, OUTPUT);
+  scheduler.schedule(toggleLed);
+  scheduler.scheduleDelayed(printTrace, 30000);
+}
+
+void loop() {
+  scheduler.execute();
+}
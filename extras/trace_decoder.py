@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""
+Decodes the output of Scheduler::dumpTrace() of the DeepSleepScheduler library into a timeline.
+
+Usage:
+  python3 trace_decoder.py [--symbols FILE] [--avr] [LOG_FILE]
+
+LOG_FILE is the text received on the serial port, stdin if omitted. Other lines
+printed by the sketch are ignored. The optional symbols file is the output of
+nm (e.g. avr-nm -C sketch.elf) to show the names of the callbacks. With --avr the
+callback ids are taken as word addresses as function pointers on AVR are.
+"""
+
+import argparse
+import sys
+
+EVENTS = {
+    1: 'SCHEDULE',
+    2: 'TASK_START',
+    3: 'TASK_END',
+    4: 'SLEEP_ENTER',
+    5: 'SLEEP_EXIT',
+    6: 'SUPERVISION_TIMEOUT',
+}
+TASK_EVENTS = (1, 2, 3)
+FLAG_RUNNABLE = 1
+FLAG_FROM_INTERRUPT = 2
+
+
+def read_symbols(path, avr):
+    symbols = {}
+    with open(path) as f:
+        for line in f:
+            parts = line.split(None, 2)
+            if len(parts) != 3 or parts[1] not in 'TtWwDdBb':
+                continue
+            address = int(parts[0], 16)
+            if avr and parts[1] in 'TtWw':
+                address //= 2
+            symbols.setdefault(address & 0xFFFF, parts[2].strip())
+    return symbols
+
+
+def parse_records(lines):
+    """yields (millis, event, arg, data) of all records and the lost count after each dump"""
+    in_dump = False
+    for line in lines:
+        line = line.strip()
+        if line.startswith('TRACE '):
+            if line != 'TRACE 1':
+                sys.exit('unsupported trace format: ' + line)
+            in_dump = True
+        elif in_dump and line.startswith('END '):
+            in_dump = False
+            yield ('END', int(line[4:]))
+        elif in_dump and len(line) == 16:
+            try:
+                value = int(line, 16)
+            except ValueError:
+                continue
+            yield (value >> 32, (value >> 24) & 0xFF, (value >> 16) & 0xFF, value & 0xFFFF)
+
+
+def describe_task(arg, data, symbols):
+    kind = 'Runnable' if arg & FLAG_RUNNABLE else 'callback'
+    name = symbols.get(data)
+    text = '%s 0x%04x' % (kind, data) + (' (%s)' % name if name else '')
+    if arg & FLAG_FROM_INTERRUPT:
+        text += ' from interrupt'
+    return text
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decodes the trace of DeepSleepScheduler')
+    parser.add_argument('log', nargs='?', help='serial output, stdin if omitted')
+    parser.add_argument('--symbols', help='output of nm to resolve the callbacks')
+    parser.add_argument('--avr', action='store_true', help='function pointers are word addresses')
+    args = parser.parse_args()
+
+    symbols = read_symbols(args.symbols, args.avr) if args.symbols else {}
+    lines = open(args.log) if args.log else sys.stdin
+
+    previous = None
+    task_start = None
+    sleep_enter = None
+    for record in parse_records(lines):
+        if record[0] == 'END':
+            if record[1] != 0:
+                print('%d events lost, dump the trace more often or increase TRACE_BUFFER_SIZE' % record[1])
+            continue
+        millis, event, arg, data = record
+        delta = '' if previous is None else '+%d' % ((millis - previous) & 0xFFFFFFFF)
+        previous = millis
+        name = EVENTS.get(event, 'UNKNOWN_%d' % event)
+
+        if event in TASK_EVENTS:
+            detail = describe_task(arg, data, symbols)
+            if event == 2:
+                task_start = millis
+            elif event == 3 and task_start is not None:
+                detail += ', ran %d ms' % ((millis - task_start) & 0xFFFFFFFF)
+                task_start = None
+        elif event == 4:
+            # a long sleep on AVR is a chain of WDT periods with one SLEEP_ENTER each
+            if sleep_enter is None:
+                sleep_enter = millis
+            detail = 'mode %d, planned %d ms' % (arg, data)
+        elif event == 5:
+            detail = 'mode %d' % arg
+            if sleep_enter is not None:
+                detail += ', slept %d ms' % ((millis - sleep_enter) & 0xFFFFFFFF)
+                sleep_enter = None
+            if data:
+                detail += ', woken up early by an other interrupt'
+        else:
+            detail = ''
+        print('%12.3f s %8s  %-19s %s' % (millis / 1000.0, delta, name, detail))
+
+
+if __name__ == '__main__':
+    main()